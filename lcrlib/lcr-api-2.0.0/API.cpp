@@ -14,10 +14,11 @@
 #include "string.h"
 #include "usb.h"
 #include "Common.h"
+#include "sequence.h"
 #include <stdlib.h>
 
-extern unsigned char OutputBuffer[];
-extern unsigned char InputBuffer[];
+extern USB_THREAD_LOCAL unsigned char OutputBuffer[];
+extern USB_THREAD_LOCAL unsigned char InputBuffer[];
 
 CmdFormat CmdList[255] =
 {
@@ -96,9 +97,7 @@ CmdFormat CmdList[255] =
     {   0x00,  0x30,  0x01   }     //BL_PROG_MODE,
 };
 
-static unsigned char seqNum=0;
-static unsigned int PatLut[128] = {0};
-static unsigned int PatLutIndex = 0;
+static USB_THREAD_LOCAL unsigned char seqNum=0;
 
 extern "C" int LCR_Write()
 {
@@ -122,6 +121,8 @@ extern "C" int LCR_Read()
     {
         ret_val =  USB_Read();
 
+        if(ret_val <= 0) //Nothing read, InputBuffer still holds an older reply
+            return -1;
         if((pMsg->head.flags.nack == 1) || (pMsg->head.length == 0))
             return -2;
         else
@@ -165,6 +166,27 @@ extern "C" int LCR_SendMsg(hidMessageStruct *pMsg)
     return dataBytesSent+sizeof(pMsg->head);
 }
 
+extern "C" int LCR_EncodeMsg(hidMessageStruct *pMsg, unsigned char *pReport)
+/**
+ * This function is private to this file. Encodes a message that fits in a single USB report into pReport, in the
+ * same format LCR_SendMsg() writes to OutputBuffer, so it can be sent later with USB_WriteReport().
+ *
+ * @param   pReport - O - USB_MAX_PACKET_SIZE+1 bytes
+ *
+ * @return  0 = PASS
+ *          -1 = FAIL (message needs more than one report)
+ *
+ */
+{
+    if(pMsg->head.length > USB_MAX_PACKET_SIZE-sizeof(pMsg->head))
+        return -1;
+
+    memset(pReport, 0, USB_MAX_PACKET_SIZE+1);
+    pReport[0]=0; // First byte is the report number
+    memcpy(&pReport[1], pMsg, (sizeof(pMsg->head) + pMsg->head.length));
+    return 0;
+}
+
 extern "C" int LCR_PrepReadCmd(LCR_CMD cmd)
 /**
  * This function is private to this file. Prepares the read-control command packet for the given command code and copies it to OutputBuffer.
@@ -835,10 +857,10 @@ extern "C" int LCR_DownloadData(unsigned char *pByteArray, unsigned int dataLen)
     if(dataLen > sendSize)
         dataLen = sendSize;
 
-    CmdList[BL_DNLD_DATA].len = dataLen;
     memcpy(&msg.text.data[2], pByteArray, dataLen);
 
     LCR_PrepWriteCmd(&msg, BL_DNLD_DATA);
+    msg.head.length = dataLen + 2; //Not in CmdList, which is shared by the threads programming other devices
 
     retval = LCR_SendMsg(&msg);
     if(retval > 0)
@@ -847,6 +869,79 @@ extern "C" int LCR_DownloadData(unsigned char *pByteArray, unsigned int dataLen)
     return -1;
 }
 
+extern "C" int LCR_EncodeDownloadData(const unsigned char *pByteArray, unsigned int dataLen, unsigned char *pReports, unsigned int *pNumReports)
+/**
+ * This function works only in prorgamming mode.
+ * Encodes one LCR_DownloadData() payload into the USB reports LCR_SendMsg() would write, so the next
+ * payload can be prepared while the previous one is being sent with LCR_SendReports().
+ * The message sequence number is assigned when the reports are sent.
+ * Doesn't touch any state shared with the other commands and may run on another thread.
+ *
+ * @param pByteArray - I - Pointer to where the data to be downloaded is to be fetched from
+ * @param dataLen - I - length in bytes of the total payload data to download.
+ * @param pReports - O - HID_MESSAGE_MAX_REPORTS reports of USB_MAX_PACKET_SIZE+1 bytes
+ * @param pNumReports - O - number of reports used
+ *
+ * @return number of payload bytes encoded
+ *
+ */
+{
+    hidMessageStruct msg;
+    unsigned int sendSize, maxDataSize, dataBytesSent, numReports = 0;
+
+    sendSize = HID_MESSAGE_MAX_SIZE - sizeof(msg.head)- sizeof(msg.text.cmd) - 2;//The last -2 is to workaround a bug in bootloader.
+
+    if(dataLen > sendSize)
+        dataLen = sendSize;
+
+    memset(&msg, 0, sizeof(msg)); //Write to the projector control endpoint, no reply
+    msg.text.cmd = (CmdList[BL_DNLD_DATA].CMD2 << 8) | CmdList[BL_DNLD_DATA].CMD3;
+    msg.head.length = dataLen + 2;
+    memcpy(&msg.text.data[2], pByteArray, dataLen);
+
+    maxDataSize = USB_MAX_PACKET_SIZE-sizeof(msg.head);
+    dataBytesSent = MIN(msg.head.length, maxDataSize);
+
+    memset(pReports, 0, USB_MAX_PACKET_SIZE+1);
+    memcpy(&pReports[1], &msg, (sizeof(msg.head) + dataBytesSent));
+    numReports++;
+
+    while(dataBytesSent < msg.head.length)
+    {
+        pReports += USB_MAX_PACKET_SIZE+1;
+        pReports[0] = 0;
+        memcpy(&pReports[1], &msg.text.data[dataBytesSent], USB_MAX_PACKET_SIZE);
+        dataBytesSent += USB_MAX_PACKET_SIZE;
+        numReports++;
+    }
+
+    *pNumReports = numReports;
+    return dataLen;
+}
+
+extern "C" int LCR_SendReports(unsigned char *pReports, unsigned int numReports)
+/**
+ * Sends a message encoded with LCR_EncodeDownloadData(), stamping it with the next sequence number.
+ *
+ * @param pReports - I - reports of the message, the sequence number is written into the first
+ * @param numReports - I - number of reports
+ *
+ * @return 0 = PASS <BR>
+ *         -1 = FAIL <BR>
+ *
+ */
+{
+    unsigned int i;
+
+    pReports[2] = seqNum++; //After the report number and the flags
+    for(i = 0; i < numReports; i++)
+    {
+        if(USB_WriteReport(&pReports[i * (USB_MAX_PACKET_SIZE+1)]) < 0)
+            return -1;
+    }
+    return 0;
+}
+
 extern "C" void LCR_WaitForFlashReady()
 /**
  * This function works only in prorgamming mode.
@@ -1735,6 +1830,28 @@ extern "C" int LCR_LoadSplash(unsigned int index)
     return LCR_SendMsg(&msg);
 }
 
+extern "C" int LCR_EncodeLoadSplash(unsigned int index, unsigned char *pReport)
+/**
+ * This API does not send any commands to the controller.
+ * It encodes the LCR_LoadSplash() command into a USB report to be sent later with USB_WriteReport(),
+ * e.g. by the scheduler at a precise time.
+ *
+ * @param   index  - I - Image Index.
+ * @param   pReport - O - USB_MAX_PACKET_SIZE+1 bytes
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    hidMessageStruct msg;
+
+    msg.text.data[2] = index;
+    LCR_PrepWriteCmd(&msg, SPLASH_LOAD);
+
+    return LCR_EncodeMsg(&msg, pReport);
+}
+
 extern "C" int LCR_GetSplashIndex(unsigned int *pIndex)
 /**
  * (I2C: 0x7F)
@@ -1974,8 +2091,7 @@ extern "C" int LCR_ClearPatLut(void)
  *
  */
 {
-    PatLutIndex = 0;
-    return 0;
+    return LCR_SeqClearPatLut(LCR_GetPatLutSequence());
 }
 
 extern "C" int LCR_AddToPatLut(int TrigType, int PatNum,int BitDepth,int LEDSelect,bool InvertPat, bool InsertBlack,bool BufSwap, bool trigOutPrev)
@@ -2035,30 +2151,7 @@ extern "C" int LCR_AddToPatLut(int TrigType, int PatNum,int BitDepth,int LEDSele
  *
  */
 {
-    unsigned int lutWord = 0;
-
-    lutWord = TrigType & 3;
-    if(PatNum > 24)
-        return -1;
-
-    lutWord |= ((PatNum & 0x3F) << 2);
-    if( (BitDepth > 8) || (BitDepth <= 0))
-        return -1;
-    lutWord |= ((BitDepth & 0xF) << 8);
-    if(LEDSelect > 7)
-        return -1;
-    lutWord |= ((LEDSelect & 0x7) << 12);
-    if(InvertPat)
-        lutWord |= BIT16;
-    if(InsertBlack)
-        lutWord |= BIT17;
-    if(BufSwap)
-        lutWord |= BIT18;
-    if(trigOutPrev)
-        lutWord |= BIT19;
-
-    PatLut[PatLutIndex++] = lutWord;
-    return 0;
+    return LCR_SeqAddToPatLut(LCR_GetPatLutSequence(), TrigType, PatNum, BitDepth, LEDSelect, InvertPat, InsertBlack, BufSwap, trigOutPrev);
 }
 
 extern "C" int LCR_GetPatLutItem(int index, int *pTrigType, int *pPatNum,int *pBitDepth,int *pLEDSelect,bool *pInvertPat, bool *pInsertBlack,bool *pBufSwap, bool *pTrigOutPrev)
@@ -2121,7 +2214,10 @@ extern "C" int LCR_GetPatLutItem(int index, int *pTrigType, int *pPatNum,int *pB
 {
     unsigned int lutWord;
 
-    lutWord = PatLut[index];
+    if(index < 0 || index >= SEQ_MAX_PAT_LUT_ENTRIES)
+        return -1;
+
+    lutWord = LCR_GetPatLutSequence()->PatLut[index];
 
     *pTrigType = lutWord & 3;
     *pPatNum = (lutWord >> 2) & 0x3F;
@@ -2213,11 +2309,33 @@ extern "C" int LCR_SendPatLut(void)
  *          -1 = FAIL  <BR>
  *
  */
+{
+    return LCR_SendPatLutWords(LCR_GetPatLutSequence()->PatLut, LCR_GetPatLutSequence()->NumPatLutEntries);
+}
+
+extern "C" int LCR_SendPatLutWords(const unsigned int *pLut, unsigned int numEntries)
+/**
+ * (I2C: 0x78)
+ * (USB: CMD2: 0x1A, CMD3: 0x34)
+ * This API sends the given pattern LUT words to the DLPC350 controller.
+ * See table 2-65 in programmer's guide for detailed desciprtion of pattern LUT entries.
+ *
+ * @param   *pLut - I - Pointer to the array of 24-bit LUT words
+ *
+ * @param   numEntries - I - number of entries to be sent to the controller (max 128)
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
 {
     hidMessageStruct msg;
-    int bytesToSend=PatLutIndex*3;
+    int bytesToSend=numEntries*3;
     unsigned int i;
 
+    if(numEntries > SEQ_MAX_PAT_LUT_ENTRIES)
+        return -1;
+
     if(LCR_OpenMailbox(2) < 0)
         return -1;
     LCR_MailboxSetAddr(0);
@@ -2225,11 +2343,11 @@ extern "C" int LCR_SendPatLut(void)
     CmdList[MBOX_DATA].len = bytesToSend;
     LCR_PrepWriteCmd(&msg, MBOX_DATA);
 
-    for(i=0; i<PatLutIndex; i++)
+    for(i=0; i<numEntries; i++)
     {
-        msg.text.data[2+3*i] = PatLut[i];
-        msg.text.data[2+3*i+1] = PatLut[i]>>8;
-        msg.text.data[2+3*i+2] = PatLut[i]>>16;
+        msg.text.data[2+3*i] = pLut[i];
+        msg.text.data[2+3*i+1] = pLut[i]>>8;
+        msg.text.data[2+3*i+2] = pLut[i]>>16;
     }
 
     LCR_SendMsg(&msg);
@@ -2341,7 +2459,7 @@ extern "C" int LCR_GetPatLut(int numEntries)
     for(i=0; i<numEntries*3; i+=3)
     {
         lutWord = msg.text.data[i] | msg.text.data[i+1] << 8 | msg.text.data[i+2] << 16;
-        PatLut[PatLutIndex++] = lutWord;
+        LCR_GetPatLutSequence()->PatLut[LCR_GetPatLutSequence()->NumPatLutEntries++] = lutWord;
     }
 
     if(LCR_CloseMailbox() < 0)
@@ -2476,6 +2594,28 @@ extern "C" int LCR_PatternDisplay(int Action)
     return LCR_SendMsg(&msg);
 }
 
+extern "C" int LCR_EncodePatternDisplay(int Action, unsigned char *pReport)
+/**
+ * This API does not send any commands to the controller.
+ * It encodes the LCR_PatternDisplay() command into a USB report to be sent later with USB_WriteReport(),
+ * e.g. by the scheduler at a precise time.
+ *
+ * @param   Action - I - see LCR_PatternDisplay()
+ * @param   pReport - O - USB_MAX_PACKET_SIZE+1 bytes
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    hidMessageStruct msg;
+
+    msg.text.data[2] = Action;
+    LCR_PrepWriteCmd(&msg, PAT_START_STOP);
+
+    return LCR_EncodeMsg(&msg, pReport);
+}
+
 extern "C" int LCR_SetPatternConfig(unsigned int numLutEntries, bool repeat, unsigned int numPatsForTrigOut2, unsigned int numSplash)
 /**
  * (I2C: 0x75)
@@ -3342,21 +3482,24 @@ extern "C" int LCR_ReadSplashLoadTiming(unsigned int *pTimingData)
   * @param   *pTimingData - I - time taken to load the specified image in milliseconds = value/18667.
   *
   * @return  >=0 = PASS    <BR>
-  *          <0 = FAIL  <BR>
+  *          -2 = the controller rejected the request, e.g. no image at the index measured <BR>
+  *          -1 = FAIL  <BR>
   *
   */
  {
      hidMessageStruct msg;
+     int ret;
 
      LCR_PrepReadCmd(SPLASH_LOAD_TIMING);
 
-     if(LCR_Read() > 0)
+     ret = LCR_Read();
+     if(ret > 0)
      {
          memcpy(&msg, InputBuffer, 65);
          *pTimingData = (msg.text.data[0] | msg.text.data[1] << 8 | msg.text.data[2] << 16 | msg.text.data[3] << 24);
          return 0;
      }
-     return -1;
+     return ret == -2 ? -2 : -1;
  }
 
  // ADDITIONS BY MARK CAFARO
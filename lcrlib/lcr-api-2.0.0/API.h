@@ -49,6 +49,7 @@
 
 #define STAT_BIT_FLASH_BUSY     BIT3
 #define HID_MESSAGE_MAX_SIZE    512
+#define HID_MESSAGE_MAX_REPORTS 9       /* USB reports needed to send a message of HID_MESSAGE_MAX_SIZE */
 
 #ifdef _WIN32
       #define API_API_EXPORT __declspec(dllexport)
@@ -231,6 +232,8 @@ extern "C" int API_API_EXPORT LCR_SetFlashAddr(unsigned int Addr);
 extern "C" int API_API_EXPORT LCR_FlashSectorErase(void);
 extern "C" int API_API_EXPORT LCR_SetDownloadSize(unsigned int dataLen);
 extern "C" int API_API_EXPORT LCR_DownloadData(unsigned char *pByteArray, unsigned int dataLen);
+extern "C" int API_API_EXPORT LCR_EncodeDownloadData(const unsigned char *pByteArray, unsigned int dataLen, unsigned char *pReports, unsigned int *pNumReports);
+extern "C" int API_API_EXPORT LCR_SendReports(unsigned char *pReports, unsigned int numReports);
 extern "C" void API_API_EXPORT LCR_WaitForFlashReady(void);
 extern "C" int API_API_EXPORT LCR_SetFlashType(unsigned char Type);
 extern "C" int API_API_EXPORT LCR_CalculateFlashChecksum(void);
@@ -238,6 +241,7 @@ extern "C" int API_API_EXPORT LCR_GetFlashChecksum(unsigned int*checksum);
 extern "C" int API_API_EXPORT LCR_SetMode(bool SLmode);
 extern "C" int API_API_EXPORT LCR_GetMode(bool *pMode);
 extern "C" int API_API_EXPORT LCR_LoadSplash(unsigned int index);
+extern "C" int API_API_EXPORT LCR_EncodeLoadSplash(unsigned int index, unsigned char *pReport);
 extern "C" int API_API_EXPORT LCR_GetSplashIndex(unsigned int *pIndex);
 extern "C" int API_API_EXPORT LCR_SetTPGColor(unsigned short redFG, unsigned short greenFG, unsigned short blueFG, unsigned short redBG, unsigned short greenBG, unsigned short blueBG);
 extern "C" int API_API_EXPORT LCR_GetTPGColor(unsigned short *pRedFG, unsigned short *pGreenFG, unsigned short *pBlueFG, unsigned short *pRedBG, unsigned short *pGreenBG, unsigned short *pBlueBG);
@@ -245,12 +249,14 @@ extern "C" int API_API_EXPORT LCR_ClearPatLut(void);
 extern "C" int API_API_EXPORT LCR_AddToPatLut(int TrigType, int PatNum,int BitDepth,int LEDSelect,bool InvertPat, bool InsertBlack,bool BufSwap, bool trigOutPrev);
 extern "C" int API_API_EXPORT LCR_GetPatLutItem(int index, int *pTrigType, int *pPatNum,int *pBitDepth,int *pLEDSelect,bool *pInvertPat, bool *pInsertBlack,bool *pBufSwap, bool *pTrigOutPrev);
 extern "C" int API_API_EXPORT LCR_SendPatLut(void);
+extern "C" int API_API_EXPORT LCR_SendPatLutWords(const unsigned int *pLut, unsigned int numEntries);
 extern "C" int API_API_EXPORT LCR_SendSplashLut(unsigned char *lutEntries, unsigned int numEntries);
 extern "C" int API_API_EXPORT LCR_GetPatLut(int numEntries);
 extern "C" int API_API_EXPORT LCR_GetSplashLut(unsigned char *pLut, int numEntries);
 extern "C" int API_API_EXPORT LCR_SetPatternTriggerMode(bool);
 extern "C" int API_API_EXPORT LCR_GetPatternTriggerMode(bool *);
 extern "C" int API_API_EXPORT LCR_PatternDisplay(int Action);
+extern "C" int API_API_EXPORT LCR_EncodePatternDisplay(int Action, unsigned char *pReport);
 extern "C" int API_API_EXPORT LCR_SetPatternConfig(unsigned int numLutEntries, bool repeat, unsigned int numPatsForTrigOut2, unsigned int numSplash);
 extern "C" int API_API_EXPORT LCR_GetPatternConfig(unsigned int *pNumLutEntries, bool *pRepeat, unsigned int *pNumPatsForTrigOut2, unsigned int *pNumSplash);
 extern "C" int API_API_EXPORT LCR_SetExposure_FramePeriod(unsigned int exposurePeriod, unsigned int framePeriod);
@@ -36,6 +36,14 @@
 
 #define GET_LINE_BYTES(Image)	(ALIGN_BYTES_NEXT((Image)->Width * (Image)->BitDepth, 32)/8)
 
+#define BMP_DATA_STORE2(Value, Data, Index)  \
+                        do { (Data)[Index] = (uint8)(Value); (Data)[(Index) + 1] = (uint8)((Value) >> 8); } while(0)
+
+#define BMP_DATA_STORE4(Value, Data, Index)  \
+                        do { BMP_DATA_STORE2((Value), Data, Index); BMP_DATA_STORE2((Value) >> 16, Data, (Index) + 2); } while(0)
+
+#define BMP_STORE_BLOCK_SIZE	0x40000	/* bytes of pixels passed to PutData at once by BMP_StoreImage24 */
+
 /**************************** LOCAL TYPES ************************************/
 typedef struct
 {
@@ -545,6 +553,79 @@ ErrorCode_t BMP_StoreImage(BMP_Image_t *Image, BMP_DataFunc_t *PutData, void *Da
 }
 
 
+/**
+*  This function stores a 24-bit image held in memory in BMP file format. Unlike
+*  BMP_StoreImage it writes the header with a single PutData call and the pixels
+*  in blocks of whole lines, so a large image takes a few calls.
+*
+*  @param Width - Width of the image
+*  @param Height - Height of the image
+*  @param Pixels - First line of the image, top line first, 3 bytes per pixel in
+*                  BMP order (blue, green, red)
+*  @param LineBytes - Distance between the lines of Pixels in bytes
+*  @param PutData - Function pointer for store the BMP file data
+*  @param DataParam - Parameter to be passed for PutData function
+*
+*  return SUCCESS, FAIL
+*/
+ErrorCode_t BMP_StoreImage24(uint32 Width, uint32 Height, uint8 const *Pixels, uint32 LineBytes,
+                                        BMP_DataFunc_t *PutData, void *DataParam)
+{
+    ErrorCode_t Error = SUCCESS;
+	uint8 Header[BMP_FILE_HEADER_SIZE + BMP_DIB_HEADER_SIZE];
+	uint32 LineWidth = ALIGN_BYTES_NEXT(Width * 3, 4);
+	uint32 DataSize = LineWidth * Height;
+	uint32 LinesPerBlock = MAX(BMP_STORE_BLOCK_SIZE / MAX(LineWidth, 1), 1);
+	uint32 Lines;
+	uint32 i;
+	uint8 *Block = NULL;
+	uint8 *Out;
+	int y;
+
+    ERR_BLOCK_BEGIN
+    {
+		memset(Header, 0, sizeof(Header));
+		BMP_DATA_STORE2(BMP_SIGNATURE, Header, 0);
+		BMP_DATA_STORE4(DataSize + sizeof(Header), Header, 2);
+		BMP_DATA_STORE4(sizeof(Header), Header, 10);			/* Pixel offset */
+		BMP_DATA_STORE4(BMP_DIB_HEADER_SIZE, Header, 14);
+		BMP_DATA_STORE4(Width, Header, 18);
+		BMP_DATA_STORE4(Height, Header, 22);
+		BMP_DATA_STORE2(1, Header, 26);					/* Number of color planes */
+		BMP_DATA_STORE2(24, Header, 28);
+		BMP_DATA_STORE4(DataSize, Header, 34);				/* Compression = None */
+		BMP_DATA_STORE4(2835, Header, 38);				/* H Res pix/meter */
+		BMP_DATA_STORE4(2835, Header, 42);				/* V Res pix/meter */
+
+		if(PutData(DataParam, Header, sizeof(Header)))
+			ERR_THROW(Error = FAIL);
+
+		LinesPerBlock = MIN(LinesPerBlock, Height);
+		Block = (uint8 *)malloc(MAX(LinesPerBlock * LineWidth, 1));
+		if(Block == NULL)
+			ERR_THROW(Error = ERR_OUT_OF_RESOURCE);
+
+		/* BMP lines are stored bottom line first */
+		for(y = Height; y > 0; y -= Lines)
+		{
+			Lines = MIN(LinesPerBlock, (uint32)y);
+			for(i = 0, Out = Block; i < Lines; i++, Out += LineWidth)
+			{
+				memcpy(Out, Pixels + (uint32)(y - 1 - i) * LineBytes, Width * 3);
+				memset(Out + Width * 3, 0, LineWidth - Width * 3);
+			}
+			if(PutData(DataParam, Block, Lines * LineWidth))
+				ERR_THROW_MSG(Error = FAIL, "Error while drawing pixel");
+		}
+	}
+	ERR_BLOCK_END;
+
+	free(Block);
+
+	return Error;
+}
+
+
 /**
 *  This function parses the BMP header present in memroy
 *
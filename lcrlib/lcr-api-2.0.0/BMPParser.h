@@ -39,6 +39,9 @@ ErrorCode_t BMP_InitImage(BMP_Image_t *Image, uint32 Width, uint32 Height, uint8
 ErrorCode_t BMP_StoreImage(BMP_Image_t *Image, BMP_DataFunc_t *PutData, void *DataParam,
                                         BMP_PixelFunc_t *GetPixels, void *PixelParam);
 
+ErrorCode_t BMP_StoreImage24(uint32 Width, uint32 Height, uint8 const *Pixels, uint32 LineBytes,
+                                        BMP_DataFunc_t *PutData, void *DataParam);
+
 uint32 BMP_ImageSize(BMP_Image_t *Image);
 
 
@@ -4,9 +4,7 @@
 #
 # Builds Ver 2.0 of DLC300 API
 #-------------------------------------------------
-QT        -= gui
-
-greaterThan(QT_MAJOR_VERSION, 4): QT -= widgets
+CONFIG    -= qt
 
 TARGET = lcr
 TEMPLATE = lib
@@ -16,12 +14,34 @@ DEFINES += lcr
 SOURCES += usb.cpp \
     API.cpp \
     BMPParser.cpp \
-    firmware.cpp
+    firmware.cpp \
+    checksum.cpp \
+    filemap.cpp \
+    sequence.cpp \
+    tuner.cpp \
+    scheduler.cpp \
+    splashtiming.cpp \
+    splashorder.cpp \
+    splashcodec.cpp \
+    threadpool.cpp \
+    flashprog.cpp \
+    splashcache.cpp
 
 HEADERS  += usb.h \
     API.h \
     BMPParser.h \
-    firmware.h
+    firmware.h \
+    checksum.h \
+    filemap.h \
+    sequence.h \
+    tuner.h \
+    scheduler.h \
+    splashtiming.h \
+    splashorder.h \
+    splashcodec.h \
+    threadpool.h \
+    flashprog.h \
+    splashcache.h
 
 INCLUDEPATH += "hidapi-master\\hidapi"
 
@@ -0,0 +1,20 @@
+/*
+ * checksum.h
+ *
+ * This module provides the checksums used to validate host side data files and flash content
+ *
+*/
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include "Common.h"
+
+#define CHKSUM_CRC32_INIT	0xFFFFFFFF
+
+uint32 CHKSUM_Crc32Update(uint32 crc, const uint8 *pData, uint32 size);
+uint32 CHKSUM_Crc32(const uint8 *pData, uint32 size);
+uint32 CHKSUM_ByteSum(const uint8 *pData, uint32 size);
+unsigned long long CHKSUM_Hash64(const uint8 *pData, uint32 size, unsigned long long seed);
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * filemap.cpp
+ *
+ * This module has the wrapper functions to memory-map files on Linux and Windows.
+ *
+*/
+
+#include "filemap.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+int FILEMAP_Open(FILEMAP *pMap, const char *path)
+/**
+ * Maps the given file read-only into the address space of the process.
+ * Empty files are not mapped and reported as failure.
+ *
+ * @param   pMap - O - mapping descriptor, to be released with FILEMAP_Close()
+ * @param   path - I - path of the file to map
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    pMap->Data = NULL;
+    pMap->Size = 0;
+    pMap->Handle = NULL;
+
+#ifdef _WIN32
+    HANDLE file, mapping;
+    DWORD sizeHigh, sizeLow;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+        return -1;
+
+    sizeLow = GetFileSize(file, &sizeHigh);
+    if(sizeLow == 0 || sizeHigh != 0)
+    {
+        CloseHandle(file);
+        return -1;
+    }
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(mapping == NULL)
+        return -1;
+
+    pMap->Data = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(pMap->Data == NULL)
+    {
+        CloseHandle(mapping);
+        return -1;
+    }
+    pMap->Size = sizeLow;
+    pMap->Handle = mapping;
+#else
+    struct stat st;
+    void *addr;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return -1;
+
+    if(fstat(fd, &st) < 0 || st.st_size == 0 || (unsigned long long)st.st_size > 0xFFFFFFFFull)
+    {
+        close(fd);
+        return -1;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED)
+        return -1;
+
+    pMap->Data = (unsigned char *)addr;
+    pMap->Size = (uint32)st.st_size;
+#endif
+    return 0;
+}
+
+void FILEMAP_Close(FILEMAP *pMap)
+/**
+ * Releases a mapping created with FILEMAP_Open(). Safe to call on a closed descriptor.
+ *
+ * @param   pMap - I - mapping descriptor
+ *
+ */
+{
+    if(pMap->Data == NULL)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(pMap->Data);
+    CloseHandle((HANDLE)pMap->Handle);
+#else
+    munmap(pMap->Data, pMap->Size);
+#endif
+    pMap->Data = NULL;
+    pMap->Size = 0;
+    pMap->Handle = NULL;
+}
@@ -0,0 +1,23 @@
+/*
+ * filemap.h
+ *
+ * This module has the wrapper functions to memory-map files on Linux and Windows.
+ *
+*/
+
+#ifndef FILEMAP_H
+#define FILEMAP_H
+
+#include "Common.h"
+
+typedef struct
+{
+    unsigned char *Data;    /* start of the mapped file, NULL if not mapped */
+    uint32 Size;            /* size of the mapped file in bytes */
+    void *Handle;           /* platform specific handle of the mapping */
+} FILEMAP;
+
+int FILEMAP_Open(FILEMAP *pMap, const char *path);
+void FILEMAP_Close(FILEMAP *pMap);
+
+#endif
@@ -9,23 +9,34 @@
 */
 
 #include "firmware.h"
+#include "splashcodec.h"
+#include "threadpool.h"
+#include "checksum.h"
+#include "splashcache.h"
+#include "scheduler.h"
+#include "BMPParser.h"
 #include "Common.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
 
 #ifdef _WIN32
     #include <windows.h>
+    #include <io.h>
 #else
-    typedef short WORD;
-    typedef long LONG;
+    #include <unistd.h>
+    typedef uint16 WORD;
+    typedef int LONG;
     typedef uint32 DWORD;
+    #pragma pack(push, 2)
     typedef struct tagBITMAPFILEHEADER {
-        WORD bfType;
-        WORD bfSize;
-        WORD bfReserved1;
-        WORD bfReserved2;
-        WORD bfOffBits;
+        WORD  bfType;
+        DWORD bfSize;
+        WORD  bfReserved1;
+        WORD  bfReserved2;
+        DWORD bfOffBits;
     } BITMAPFILEHEADER, *PBITMAPFILEHEADER;
+    #pragma pack(pop)
     typedef struct tagBITMAPINFOHEADER {
         DWORD biSize;
         LONG  biWidth;
@@ -47,246 +58,130 @@ unsigned char *pFrmwImageArray, *splBuffer;
 uint32 splash_index, splash_data_start_flash_address, appl_config_data_start_address;
 int splash_count;
 
-#define FLASH_THREE_ADDRESS					0xFB000000	// actually it is re map to 0xF8000000
-#define FLASH_TWO_ADDRESS					0xFA000000
-#define FLASH_BASE_ADDRESS					0xF9000000
-
-uint32 ChipSelectSize[3] = {0x01000000, 0x01000000, 0x01000000};
-uint32 ChipSelectEnd[3]  = {0xFC000000, 0xFA000000, 0xFB000000};
-uint32 ChipSelectBase[3] = {0xFB000000, 0xF9000000, 0xFA000000};
+/* Splash output: either splBuffer, grown geometrically up to splash_capacity, or a file being streamed */
+static uint32 splash_capacity;
+static int splash_stream_fd = -1, splash_stream_count;
+static SPLASH_BLOB_INFO splash_stream_blobs[MAX_SPLASH_IMAGES];
 
-static int SPLASH_PerformLineCompression(unsigned char *SourceAddr, int ImageWidth, int ImageHeight, uint32 *compressed_size, uint8 numLines)
+/* Content hash of every blob written to the splash output, so identical images share their data */
+typedef struct
 {
-        uint16 Row, Col;
-	uint32 lineLength, bytesPerPixel = 3, imageHeight, pixelIndex;
-	unsigned char *line1Data, *line2Data;
+	unsigned long long Hash;
+	int Index;		/* blob table entry pointing at the data */
+} SPLASH_BLOB_HASH;
 
-	lineLength =  ImageWidth * bytesPerPixel;
+static SPLASH_BLOB_HASH splash_hashes[MAX_SPLASH_IMAGES];
+static int splash_hash_count;
+static uint32 splash_bytes_shared;
 
-	if(lineLength % 4 != 0)
-    	{
-		lineLength = (lineLength / 4 + 1) * 4;
-    	}
+/* Directory of the blob cache, empty if disabled, and its use by the current build */
+static char splash_cache_dir[1024];
+static volatile long splash_cache_hits, splash_cache_misses;
 
-	if(numLines > 8)
-	{
-		*compressed_size = 0xFFFFFFFF;
-		return 1;
-	}
+#define SPLASH_ENCODER_VERSION		2	/* change when the encoder output changes, invalidates cached blobs */
+#define SPLASH_4LINE_PERIOD		4	/* lines stored by SPLASH_4LINE_COMPRESSION and repeated down the image */
 
-	imageHeight = (ImageHeight / numLines) * numLines;
+/* Load time model the auto compression meets splash_load_target with if splash_load_policy is set,
+ * see Frmw_SPLASH_SetLoadPolicy, and the predicted load time of every image of the current build */
+#define SPLASH_VALID_COMPRESSION(c)	((c) == SPLASH_UNCOMPRESSED || (c) == SPLASH_RLE_COMPRESSION || (c) == SPLASH_4LINE_COMPRESSION)
+static SPLASH_LOAD_MODEL splash_load_model;
+static uint32 splash_load_target;
+static BOOL splash_load_policy;
+static uint32 splash_load_times[MAX_SPLASH_IMAGES];
 
-        for (Row = 0; Row < (imageHeight - numLines); Row++)
-        {
-        line1Data = (unsigned char *)(SourceAddr + (lineLength *  Row));
-        line2Data = (unsigned char *)(SourceAddr + (lineLength * (Row + numLines)));
+#define FLASH_THREE_ADDRESS					0xFB000000	// actually it is re map to 0xF8000000
+#define FLASH_TWO_ADDRESS					0xFA000000
+#define FLASH_BASE_ADDRESS					0xF9000000
 
-        	for (Col = 0; Col < ImageWidth; Col++)
-        	{
-			pixelIndex = Col * bytesPerPixel;
+uint32 ChipSelectSize[3] = {0x01000000, 0x01000000, 0x01000000};
+uint32 ChipSelectEnd[3]  = {0xFC000000, 0xFA000000, 0xFB000000};
+uint32 ChipSelectBase[3] = {0xFB000000, 0xF9000000, 0xFA000000};
 
-			if( (line1Data[pixelIndex  ] != line2Data[pixelIndex  ]) || 
-				(line1Data[pixelIndex+1] != line2Data[pixelIndex+1]) || 
-				(line1Data[pixelIndex+2] != line2Data[pixelIndex+2]))
-			{
-				*compressed_size = 0xFFFFFFFF;
-				return 1;
-			}
-		}
-    }
+static int SPLASH_PerformRLECompression(unsigned char *SourceAddr, unsigned char *DestinationAddr, int ImageWidth, int ImageHeight, uint32 *compressed_size)
+{
+    *compressed_size = SPLASH_RLECompress(SourceAddr, DestinationAddr, ImageWidth, ImageHeight);
 
-    *compressed_size = numLines * lineLength;	
     return 0;
 }
 
-static int SPLASH_PerformRLECompression(unsigned char *SourceAddr, unsigned char *DestinationAddr, int ImageWidth, int ImageHeight, uint32 *compressed_size)
+/* Decodes splash image data to lines of width*3 bytes, undoing the channel swap done when it was added */
+static int SPLASH_DecodeImage(const unsigned char *pData, uint32 size, uint16 width, uint16 height, uint8 compression,
+				unsigned char *pImageBuffer)
 {
-    uint16 Row, Col;
-    BOOL   FirstPixel = TRUE;
-    uint8 Repeat = 1;
-    uint32 Pixel = 0, S, D;
-    uint32 LastColor = 0, pad;                 
-    uint8 count = 0;
-
-//    uint8 *SourceAddr		= (uint08 *)(SplashRLECfg->SourceAddr);
-//    uint8 *DestinationAddr = (uint08 *)(SplashRLECfg->DestinationAddr);
-    uint32 PixelSize		= 3;
-    
-    S = 0;
-    D = 0;
-
-    /* RLE Encode the Splash Image*/
-    for (Row = 0; Row < ImageHeight; Row++)
-    {
-        for (Col = 0; Col < ImageWidth; Col++)
-        {
-
-	    memcpy(&Pixel, SourceAddr + S, PixelSize);
-
-            /* if this is the first Pixel, remember it and move on... */
-            if (FirstPixel)
-            {
-                LastColor  = Pixel;
-                Repeat  = 1;
-                FirstPixel = FALSE;
-                count = 0;
-            }
-            else
-            {
-                if (Pixel == LastColor)
-                {
-                    if (count)
-                    {
-						if(count > 1) DestinationAddr[D++] = 0;
-						DestinationAddr[D++] = count;
-						memcpy(DestinationAddr + D, SourceAddr + (S - ((count + 1) * PixelSize)) , count * PixelSize);
-						D += (count * PixelSize);
-                        count = 0;
-                    }
-
-                    Repeat++;
-
-                    if (Repeat == 255)
-                    {
-						DestinationAddr[D++] = Repeat;
-						memcpy(DestinationAddr + D, &LastColor, PixelSize);
-						D += PixelSize;
-                        FirstPixel = TRUE;
-                    }
-                }
-                else
-                {
-                    if (Repeat == 1)
-                    {
-                        count++;
-                        if (count == 255)
-                        {
-							if(count > 1) DestinationAddr[D++] = 0;
-							DestinationAddr[D++] = count;
-							memcpy(DestinationAddr + D, SourceAddr + (S - ((count + 1) * PixelSize)), count * PixelSize);
-                            D += (count * PixelSize);
-                            count = 0;
-                        }
-                    }
-                    else
-                    {
-                        DestinationAddr[D++] = Repeat;
-						memcpy(DestinationAddr + D, &LastColor, PixelSize);
-						D += PixelSize;
-                        Repeat = 1;
-                    }
-                    LastColor = Pixel;
-                }
-            }
-
-            /* Last Pixel of the line*/
-            if (Col == (ImageWidth-1) && Repeat != 255 && count != 255)
-            {
-                if (count)
-                {
-					DestinationAddr[D++] = 0;
-					DestinationAddr[D++] = count + 1;
-					memcpy(DestinationAddr + D, SourceAddr + (S - ((count + 2) * PixelSize)), (count + 1) * PixelSize);
-                    D += ((count + 1) * PixelSize);
-                    count = 0;
-                }
-                else
-                {
-					DestinationAddr[D++] = Repeat;
-					memcpy(DestinationAddr + D, &LastColor, PixelSize);
-					D += PixelSize;
-                }
-                FirstPixel = TRUE;
-            }
-            S += PixelSize;
-	    
-        }
-		// END OF LINE
-		DestinationAddr[D++] = 0;
-		DestinationAddr[D++] = 0;
-
-        /* Scan lines are always padded out to next 32-bit boundary */
-		if(D % 4 != 0)
-		{
-			pad = 4 - (D % 4);
-			memset(DestinationAddr + D, 0, pad);
-			D += pad;
-		}
-    }
+	uint32 lineLength = width * 3, storedLineLength, imageSize = lineLength * height, decodedSize;
+	uint32 i;
 
-    /* End of file: Control Byte = 0 & Color Byte = 1 */
-	DestinationAddr[D++] = 0;
-	DestinationAddr[D++] = 1;
+	storedLineLength = (lineLength + 3) & ~3;
+	if(imageSize == 0)
+		return 0;
 
-    /* End of file should be padded out till 128-bit boundary */
-	if(D % 16 != 0)
+	switch(compression)
 	{
-		pad = 16 - (D % 16);
-		memset(DestinationAddr + D, 0, pad);
-		D += pad;
-	}
+	case SPLASH_4LINE_COMPRESSION:
+		if(size < 4 * storedLineLength)
+			return ERROR_WRONG_PARAMS;
+		for (i = 0; i < height && i < 4; i++)
+			SPLASH_CopyPixelsSwapped(pImageBuffer + lineLength * i, pData + storedLineLength * i, width);
+		for (; i < height; i++)
+			memcpy(pImageBuffer + lineLength * i, pImageBuffer + lineLength * (i % 4), lineLength);
+		break;
 
-    // update flash size
-    *compressed_size = D;
+	case SPLASH_RLE_COMPRESSION:
+		if(SPLASH_RLEDecode(pData, size, pImageBuffer, imageSize, &decodedSize) < 0)
+			return ERROR_WRONG_PARAMS;
+		if(decodedSize < imageSize)
+			memset(pImageBuffer + decodedSize, 0, imageSize - decodedSize);
+		break;
 
-    return 0;
+	case SPLASH_UNCOMPRESSED:
+		if(size < storedLineLength * (height - 1) + lineLength)
+			return ERROR_WRONG_PARAMS;
+		for (i = 0; i < height; i++)
+			SPLASH_CopyPixelsSwapped(pImageBuffer + lineLength * i, pData + storedLineLength * i, width);
+		break;
+
+	default:
+		return ERROR_WRONG_PARAMS;
+	}
+	return 0;
 }
 
-static int SPLASH_PerformRLEUnCompression(unsigned char *SourceAddr, unsigned char *DestinationAddr, uint32 *size)
+/* Possible locations of the flash table, in the order they are probed */
+static const uint32 FlashTableAddresses[] = {0x00020000, 0x00008000};
+
+int Frmw_FindFlashTable(const unsigned char *pImage, uint32 size, uint32 *pAddress)
+/**
+ * Locates the flash table of a firmware image without modifying anything.
+ *
+ * @param   pImage - I - firmware image
+ * @param   size - I - size of the image in bytes
+ * @param   pAddress - O - offset of the flash table in the image
+ *
+ * @return  0 = PASS, ERROR_FRMW_FLASH_TABLE_SIGN_MISMATCH if there is no valid table
+ *
+ */
 {
-	uint32 PixelSize= 3, S = 0, D = 0;
-	int i;
+	const FLASH_TABLE *flash_table;
+	uint32 i;
 
-	while (S < *size)
+	for(i = 0; i < sizeof(FlashTableAddresses) / sizeof(FlashTableAddresses[0]); i++)
 	{
-		uint32 ctrl_byte, color_byte;
+		if(FlashTableAddresses[i] + sizeof(FLASH_TABLE) > size)
+			continue;
 
-		ctrl_byte = SourceAddr[S];
-		color_byte = SourceAddr[S + 1];
-		if (ctrl_byte == 0)
-		{  
-			if (color_byte == 1)	// End of image
-				break;
-			else if (color_byte == 0)	// End of Line.
-			{
-				i = 0;
-				S +=2;
-				if (S % 4 != 0)
-				{
-					int pad = 4 - (S % 4);
-					S += pad;
-				}
-			}
-			else if (color_byte >= 2)
-			{
-				S +=2;
-				memcpy(DestinationAddr + D, SourceAddr + S, color_byte * PixelSize);
-				D += color_byte * PixelSize;
-				S += color_byte * PixelSize;
-			}
-			else
-				return -1;
-		}
-		else if (ctrl_byte > 0)
+		flash_table = (const FLASH_TABLE *)(pImage + FlashTableAddresses[i]);
+		if(flash_table->Signature == FLASHTABLE_APP_SIGNATURE)
 		{
-			S++;
-			for (i = 0; i < ctrl_byte; i++)
-			{
-				memcpy(DestinationAddr + D, SourceAddr + S, PixelSize);
-				D += PixelSize;
-			}
-			S += PixelSize;
+			*pAddress = FlashTableAddresses[i];
+			return 0;
 		}
-		else
-			return -1;
 	}
-	*size = D;
-	return 0;
+	return ERROR_FRMW_FLASH_TABLE_SIGN_MISMATCH;
 }
 
 int Frmw_CopyAndVerifyImage(const unsigned char *pByteArray, int size)
 {
-	FLASH_TABLE *flash_table, *flash_table_temp = NULL;
+	FLASH_TABLE *flash_table;
 
 	if (pFrmwImageArray != NULL)
 	{
@@ -302,31 +197,159 @@ int Frmw_CopyAndVerifyImage(const unsigned char *pByteArray, int size)
 
 	memcpy(pFrmwImageArray, pByteArray, size);
 
+	if(Frmw_FindFlashTable(pFrmwImageArray, size, &FLASH_TABLE_ADDRESS) < 0)
+		return ERROR_FRMW_FLASH_TABLE_SIGN_MISMATCH;
+
 	flash_table = (FLASH_TABLE *)(pFrmwImageArray + FLASH_TABLE_ADDRESS);
-	flash_table_temp = (FLASH_TABLE *)(pByteArray + FLASH_TABLE_ADDRESS);
 
-	if(flash_table->Signature != FLASHTABLE_APP_SIGNATURE)
-	{
-		FLASH_TABLE_ADDRESS = 0x00008000;
-		
-		flash_table = (FLASH_TABLE *)(pFrmwImageArray + FLASH_TABLE_ADDRESS);
-		
-		if(flash_table->Signature != FLASHTABLE_APP_SIGNATURE)
-		{
-			FLASH_TABLE_ADDRESS = 0x00020000;
-			
-			flash_table = (FLASH_TABLE *)(pFrmwImageArray + FLASH_TABLE_ADDRESS);
-			
-			if(flash_table->Signature != FLASHTABLE_APP_SIGNATURE)
-				return ERROR_FRMW_FLASH_TABLE_SIGN_MISMATCH;
-		}
-	}
 	splash_data_start_flash_address = flash_table->Splash_Data[FLASH_TABLE_SPLASH_INDEX].Address;
 	appl_config_data_start_address = flash_table->APPL_Config_Data[0].Address;
 	
 	return 0;
 }
 
+int Frmw_ViewFlashToOffset(const FRMW_VIEW *pView, uint32 address, uint32 size, uint32 *pOffset)
+/**
+ * Translates a flash address, as used in the flash table and blob table, to an offset in the image.
+ * Addresses below the base are chip select 0, which is remapped when the image is built.
+ *
+ * @param   address - I - flash address
+ * @param   size - I - number of bytes that must be available at the address
+ * @param   pOffset - O - offset in the image
+ *
+ * @return  0 = PASS, ERROR_WRONG_PARAMS if the range is not inside the image
+ *
+ */
+{
+	uint32 offset;
+
+	if(address < FLASH_BASE_ADDRESS)
+		address += 0x03000000;
+	if(address < FLASH_BASE_ADDRESS)
+		return ERROR_WRONG_PARAMS;
+
+	offset = address - FLASH_BASE_ADDRESS;
+	if(offset > pView->Size || size > pView->Size - offset)
+		return ERROR_WRONG_PARAMS;
+
+	*pOffset = offset;
+	return 0;
+}
+
+int Frmw_ViewInit(FRMW_VIEW *pView, const unsigned char *pImage, uint32 size)
+/**
+ * Sets up a view of a firmware image in memory: locates and validates the flash table and
+ * the splash blob table. Nothing is copied, the image must stay valid while the view is used.
+ *
+ * @param   pView - O - view
+ * @param   pImage - I - firmware image
+ * @param   size - I - size of the image in bytes
+ *
+ * @return  0 = PASS, otherwise ERROR_xxx
+ *
+ */
+{
+	const SPLASH_SUPER_BINARY_INFO *binary_info;
+	uint32 offset;
+	int ret;
+
+	memset(pView, 0, sizeof(*pView));
+	pView->pImage = pImage;
+	pView->Size = size;
+	pView->SplashCount = -1;
+
+	ret = Frmw_FindFlashTable(pImage, size, &pView->FlashTableAddress);
+	if(ret < 0)
+		return ret;
+	pView->pFlashTable = (const FLASH_TABLE *)(pImage + pView->FlashTableAddress);
+
+	/* Only images built with the splash blob table have indexed splash images */
+	if(Frmw_ViewFlashToOffset(pView, pView->pFlashTable->Splash_Data[FLASH_TABLE_SPLASH_INDEX].Address,
+				  sizeof(SPLASH_SUPER_BINARY_INFO), &offset) < 0)
+		return 0;
+
+	binary_info = (const SPLASH_SUPER_BINARY_INFO *)(pImage + offset);
+	if(binary_info->Sig1 != 0x12345678 || binary_info->Sig2 != 0x87654321)
+		return 0;
+	if(binary_info->BlobCount > (size - offset - sizeof(*binary_info)) / sizeof(SPLASH_BLOB_INFO))
+		return 0;
+
+	pView->pSplashInfo = binary_info;
+	pView->pBlobs = (const SPLASH_BLOB_INFO *)(binary_info + 1);
+	pView->SplashCount = binary_info->BlobCount;
+	return 0;
+}
+
+int Frmw_ViewOpen(FRMW_VIEW *pView, const char *path)
+/**
+ * Maps a firmware file read-only and sets up a view of it, see Frmw_ViewInit.
+ *
+ * @return  0 = PASS, otherwise ERROR_xxx
+ *
+ */
+{
+	FILEMAP map;
+	int ret;
+
+	if(FILEMAP_Open(&map, path) < 0)
+		return ERROR_WRONG_PARAMS;
+
+	ret = Frmw_ViewInit(pView, map.Data, map.Size);
+	pView->Map = map;
+	if(ret < 0)
+		Frmw_ViewClose(pView);
+	return ret;
+}
+
+void Frmw_ViewClose(FRMW_VIEW *pView)
+{
+	FILEMAP_Close(&pView->Map);
+	memset(pView, 0, sizeof(*pView));
+	pView->SplashCount = -1;
+}
+
+const SPLASH_BLOB_INFO *Frmw_ViewGetBlob(const FRMW_VIEW *pView, int index)
+/**
+ * @return  entry of the blob table, NULL if there is no such splash image
+ *
+ */
+{
+	if(index < 0 || index >= pView->SplashCount)
+		return NULL;
+	if(pView->pBlobs[index].BlobOffset == 0xFFFFFFFF)
+		return NULL;
+	return &pView->pBlobs[index];
+}
+
+const SPLASH_HEADER *Frmw_ViewGetSplashHeader(const FRMW_VIEW *pView, int index, const unsigned char **ppData, uint32 *pDataSize)
+/**
+ * Returns the header of a splash image and the location of its data in the image.
+ *
+ * @param   index - I - splash image index
+ * @param   ppData - O - start of the image data, may be NULL
+ * @param   pDataSize - O - size of the image data, may be NULL
+ *
+ * @return  header, NULL if there is no such image or its blob is not inside the firmware image
+ *
+ */
+{
+	const SPLASH_BLOB_INFO *blob_info = Frmw_ViewGetBlob(pView, index);
+	const SPLASH_HEADER *splash_header;
+	uint32 offset;
+
+	if(blob_info == NULL || blob_info->BlobSize < sizeof(SPLASH_HEADER))
+		return NULL;
+	if(Frmw_ViewFlashToOffset(pView, blob_info->BlobOffset, blob_info->BlobSize, &offset) < 0)
+		return NULL;
+
+	splash_header = (const SPLASH_HEADER *)(pView->pImage + offset);
+	if(ppData)
+		*ppData = pView->pImage + offset + sizeof(SPLASH_HEADER);
+	if(pDataSize)
+		*pDataSize = blob_info->BlobSize - sizeof(SPLASH_HEADER);
+	return splash_header;
+}
+
 uint32 Frmw_GetVersionNumber()
 {
 	uint32 version_number;
@@ -357,12 +380,9 @@ uint32 Frmw_GetSPlashFlashStartAddress()
 
 int Frmw_GetSpashImage(unsigned char *pImageBuffer, int index)
 {
-	FLASH_TABLE *flash_table;
 	SPLASH_BLOB_INFO blob_info;
 	uint32 blob_address, splash_image_address, splash_image_size;
 	SPLASH_HEADER splash_header;
-	unsigned char *image_buffer, *lineData;
-	int i, j, lineLength;
 	uint32 splash_data_start_address = splash_data_start_flash_address - FLASH_BASE_ADDRESS;
 
 	blob_address = splash_data_start_address + sizeof(SPLASH_SUPER_BINARY_INFO) + index * sizeof(blobinfo);
@@ -382,75 +402,372 @@ int Frmw_GetSpashImage(unsigned char *pImageBuffer, int index)
 
 	splash_image_size = blob_info.BlobSize - sizeof(splash_header);
 
-	if (splash_header.Compression == SPLASH_4LINE_COMPRESSION)
+	return SPLASH_DecodeImage(pFrmwImageArray + splash_image_address, splash_image_size, splash_header.Image_width,
+				  splash_header.Image_height, splash_header.Compression, pImageBuffer);
+}
+
+int Frmw_SplashIndexBuild(SPLASH_INDEX *pIndex, const FRMW_VIEW *pView)
+/**
+ * Builds the index of the splash images of a firmware image from the blob table and the splash
+ * headers. Only the metadata is read; images are decoded on demand.
+ *
+ * @param   pIndex - O - index, to be released with Frmw_SplashIndexFree
+ * @param   pView - I - firmware image, must stay open while the index is used
+ *
+ * @return  number of splash image slots, otherwise ERROR_xxx
+ *
+ */
+{
+	const SPLASH_HEADER *splash_header;
+	const unsigned char *pData;
+	SPLASH_INDEX_ENTRY *entry;
+	int i;
+
+	pIndex->pView = pView;
+	pIndex->Count = 0;
+	pIndex->pEntries = NULL;
+
+	if(pView->SplashCount < 0)
+		return ERROR_NO_SPLASH_IMAGE;
+
+	pIndex->pEntries = (SPLASH_INDEX_ENTRY *)calloc(MAX(pView->SplashCount, 1), sizeof(SPLASH_INDEX_ENTRY));
+	if(pIndex->pEntries == NULL)
+		return ERROR_NO_MEM_FOR_MALLOC;
+	pIndex->Count = pView->SplashCount;
+
+	for(i = 0; i < pIndex->Count; i++)
 	{
-		unsigned char *fourLine_buffer;
+		entry = &pIndex->pEntries[i];
+		splash_header = Frmw_ViewGetSplashHeader(pView, i, &pData, &entry->Size);
+		if(splash_header == NULL)
+			continue;
+
+		entry->Offset = pData - pView->pImage;
+		entry->Width = splash_header->Image_width;
+		entry->Height = splash_header->Image_height;
+		entry->Compression = splash_header->Compression;
+		entry->Valid = TRUE;
+	}
+	return pIndex->Count;
+}
+
+void Frmw_SplashIndexFree(SPLASH_INDEX *pIndex)
+{
+	free(pIndex->pEntries);
+	pIndex->pEntries = NULL;
+	pIndex->Count = 0;
+}
 
-		fourLine_buffer = (unsigned char *)malloc(splash_image_size);
-		if(fourLine_buffer == NULL)
-			return ERROR_NO_MEM_FOR_MALLOC;	
+const SPLASH_INDEX_ENTRY *Frmw_SplashIndexGet(const SPLASH_INDEX *pIndex, int index)
+/**
+ * @return  index entry, NULL if there is no such splash image
+ *
+ */
+{
+	if(index < 0 || index >= pIndex->Count || !pIndex->pEntries[index].Valid)
+		return NULL;
+	return &pIndex->pEntries[index];
+}
 
-		memcpy(fourLine_buffer, pFrmwImageArray + splash_image_address, splash_image_size);
+int Frmw_SplashIndexDecode(const SPLASH_INDEX *pIndex, int index, unsigned char *pImageBuffer, uint32 bufferSize)
+/**
+ * Decodes a splash image directly into the caller's buffer, in the same format as Frmw_GetSpashImage:
+ * Image_height lines of Image_width 24-bit pixels without padding.
+ *
+ * @param   index - I - splash image index
+ * @param   pImageBuffer - O - decoded image
+ * @param   bufferSize - I - size of pImageBuffer, at least Image_width * Image_height * 3
+ *
+ * @return  0 = PASS, otherwise ERROR_xxx
+ *
+ */
+{
+	const SPLASH_INDEX_ENTRY *entry = Frmw_SplashIndexGet(pIndex, index);
 
-		image_buffer =  (unsigned char *)malloc(splash_header.Image_width * splash_header.Image_height * 3); // We only support 24 bit format.
-		if(image_buffer == NULL)
-			return ERROR_NO_MEM_FOR_MALLOC;
+	if(entry == NULL)
+		return ERROR_NO_SPLASH_IMAGE;
+	if(bufferSize < (uint32)entry->Width * entry->Height * 3)
+		return ERROR_WRONG_PARAMS;
+
+	return SPLASH_DecodeImage(pIndex->pView->pImage + entry->Offset, entry->Size, entry->Width, entry->Height,
+				  entry->Compression, pImageBuffer);
+}
+
+const unsigned char *Frmw_SplashIndexView(const SPLASH_INDEX *pIndex, int index, uint32 *pLineLength)
+/**
+ * Gives direct access to the pixels of an uncompressed splash image without decoding it. The pixels
+ * are as stored in flash: lines padded to 32 bits, and the 2nd and 3rd byte of each pixel swapped
+ * compared to the decoded image.
+ *
+ * @param   index - I - splash image index
+ * @param   pLineLength - O - distance between lines in bytes
+ *
+ * @return  first line of the image, NULL if the image doesn't exist or is compressed
+ *
+ */
+{
+	const SPLASH_INDEX_ENTRY *entry = Frmw_SplashIndexGet(pIndex, index);
+	uint32 lineLength;
 
-		for (i = 0; i < splash_header.Image_height; i+=4)
-			memcpy((image_buffer + (splash_header.Image_width * 3 * i)), fourLine_buffer, splash_image_size);
+	if(entry == NULL || entry->Compression != SPLASH_UNCOMPRESSED)
+		return NULL;
+
+	lineLength = (entry->Width * 3 + 3) & ~3;
+	if(entry->Height > 0 && entry->Size < lineLength * (entry->Height - 1) + entry->Width * 3)
+		return NULL;
+
+	*pLineLength = lineLength;
+	return pIndex->pView->pImage + entry->Offset;
+}
+
+typedef struct
+{
+	const SPLASH_INDEX *pIndex;
+	const char *pathFormat;
+	int *pResults;
+	volatile long Written;
+} SPLASH_EXPORT;
+
+static ErrorCode_t SPLASH_ExportPutData(void *Param, uint8 *Data, uint32 Size)
+{
+	return fwrite(Data, 1, Size, (FILE *)Param) == Size ? SUCCESS : FAIL;
+}
 
-		splash_image_size = splash_header.Image_width * splash_header.Image_height * 3;
+/* Decodes one splash image and writes it to its BMP file */
+static void SPLASH_ExportTask(void *pContext, unsigned int index)
+{
+	SPLASH_EXPORT *pExport = (SPLASH_EXPORT *)pContext;
+	const SPLASH_INDEX_ENTRY *entry = Frmw_SplashIndexGet(pExport->pIndex, index);
+	unsigned char *pImageBuffer;
+	uint32 size;
+	char path[1024];
+	FILE *fp;
+	int ret;
+
+	pExport->pResults[index] = 0;
+	if(entry == NULL)
+		return;
+
+	size = (uint32)entry->Width * entry->Height * 3;
+	pImageBuffer = (unsigned char *)malloc(MAX(size, 1));
+	if(pImageBuffer == NULL)
+	{
+		pExport->pResults[index] = ERROR_NO_MEM_FOR_MALLOC;
+		return;
 	}
-	else if (splash_header.Compression == SPLASH_RLE_COMPRESSION)
+
+	ret = Frmw_SplashIndexDecode(pExport->pIndex, index, pImageBuffer, size);
+	if(ret == 0)
 	{
-		unsigned char* rle_buffer;
+		ret = ERROR_WRITE_FAILED;
+		if(snprintf(path, sizeof(path), pExport->pathFormat, index) < (int)sizeof(path) && (fp = fopen(path, "wb")) != NULL)
+		{
+			/* The pixels are written in large blocks, stdio buffering would only copy them */
+			setvbuf(fp, NULL, _IONBF, 0);
+			if(BMP_StoreImage24(entry->Width, entry->Height, pImageBuffer, entry->Width * 3, SPLASH_ExportPutData, fp) == SUCCESS)
+				ret = 0;
+			if(fclose(fp) != 0)
+				ret = ERROR_WRITE_FAILED;
+		}
+	}
 
-		rle_buffer = (unsigned char *)malloc(splash_image_size);
-		if(rle_buffer == NULL)
-			return ERROR_NO_MEM_FOR_MALLOC;
-		
-		image_buffer =  (unsigned char *)malloc(splash_header.Image_width * splash_header.Image_height * 3); // We only support 24 bit format.
-		if(image_buffer == NULL)
-			return ERROR_NO_MEM_FOR_MALLOC;
+	free(pImageBuffer);
+	pExport->pResults[index] = ret;
+	if(ret == 0)
+		THREAD_AtomicIncrement(&pExport->Written);
+}
+
+int Frmw_SplashIndexExport(const SPLASH_INDEX *pIndex, const char *pathFormat, int numThreads, int *pNumWritten,
+				uint32 *pImagesPerSecond)
+/**
+ * Writes every splash image of a firmware image to a 24-bit BMP file. The images are decoded and
+ * written on a pool of worker threads, each straight from the firmware image to its own file.
+ *
+ * @param   pIndex - I - index of the firmware image
+ * @param   pathFormat - I - printf format of the file names with one integer conversion for the
+ *                           splash image index, e.g. "dump/splash_%03d.bmp"
+ * @param   numThreads - I - worker threads, 0 = one per core
+ * @param   pNumWritten - O - number of BMP files written
+ * @param   pImagesPerSecond - O - export rate, NULL if not needed
+ *
+ * @return  0 = PASS <BR>
+ *          otherwise the error of the first image that failed, the other images are still written <BR>
+ *
+ */
+{
+	SPLASH_EXPORT export_job;
+	unsigned long long startTime, elapsed;
+	int i, ret;
+
+	*pNumWritten = 0;
+	if(pImagesPerSecond != NULL)
+		*pImagesPerSecond = 0;
+	if(pIndex->Count == 0)
+		return 0;
+
+	export_job.pIndex = pIndex;
+	export_job.pathFormat = pathFormat;
+	export_job.Written = 0;
+	export_job.pResults = (int *)malloc(pIndex->Count * sizeof(int));
+	if(export_job.pResults == NULL)
+		return ERROR_NO_MEM_FOR_MALLOC;
 
-		memcpy(rle_buffer, pFrmwImageArray + splash_image_address, splash_image_size);
+	startTime = LCR_SchedNow();
+	THREAD_ParallelFor(pIndex->Count, SPLASH_ExportTask, &export_job, numThreads);
+	elapsed = LCR_SchedNow() - startTime;
 
-		SPLASH_PerformRLEUnCompression(rle_buffer, image_buffer, &splash_image_size);
-		free(rle_buffer);
+	for(i = 0, ret = 0; i < pIndex->Count && ret == 0; i++)
+		ret = export_job.pResults[i];
+	free(export_job.pResults);
+
+	*pNumWritten = (int)THREAD_AtomicLoad(&export_job.Written);
+	if(pImagesPerSecond != NULL && elapsed > 0)
+		*pImagesPerSecond = (uint32)(*pNumWritten * 1000000000ULL / elapsed);
+	return ret;
+}
+
+
+/* Writes the whole buffer at the given file offset */
+static int SPLASH_WriteFile(int fd, uint32 offset, const void *pData, uint32 size)
+{
+	const unsigned char *p = (const unsigned char *)pData;
+	int n;
+
+	while(size > 0)
+	{
+#ifdef _WIN32
+		if(_lseeki64(fd, offset, SEEK_SET) < 0)
+			return ERROR_WRITE_FAILED;
+		n = _write(fd, p, MIN(size, 0x40000000));
+#else
+		n = pwrite(fd, p, size, offset);
+#endif
+		if(n <= 0)
+			return ERROR_WRITE_FAILED;
+		p += n;
+		offset += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static int SPLASH_ReadFile(int fd, uint32 offset, void *pData, uint32 size)
+{
+	unsigned char *p = (unsigned char *)pData;
+	int n;
+
+	while(size > 0)
+	{
+#ifdef _WIN32
+		if(_lseeki64(fd, offset, SEEK_SET) < 0)
+			return ERROR_READ_FAILED;
+		n = _read(fd, p, MIN(size, 0x40000000));
+#else
+		n = pread(fd, p, size, offset);
+#endif
+		if(n <= 0)
+			return ERROR_READ_FAILED;
+		p += n;
+		offset += n;
+		size -= n;
 	}
-	else if (splash_header.Compression == SPLASH_UNCOMPRESSED)
+	return 0;
+}
+
+static int SPLASH_ReserveBuffer(uint32 size)
+{
+	unsigned char *pNew;
+	uint32 capacity;
+
+	if(size <= splash_capacity)
+		return 0;
+
+	/* Grow geometrically so adding many images doesn't copy the buffer over and over */
+	capacity = MAX(size, splash_capacity + splash_capacity / 2);
+	pNew = (unsigned char *)realloc(splBuffer, capacity);
+	if(pNew == NULL)
 	{
-		image_buffer = (unsigned char *)malloc(splash_image_size);
-		if(image_buffer == NULL)
+		pNew = (unsigned char *)realloc(splBuffer, size);
+		if(pNew == NULL)
 			return ERROR_NO_MEM_FOR_MALLOC;
-		
-		memcpy(image_buffer, pFrmwImageArray + splash_image_address, splash_image_size);
+		capacity = size;
 	}
+	splBuffer = pNew;
+	splash_capacity = capacity;
+	return 0;
+}
+
+/* Writes to the splash output at the given offset from the start of the splash data */
+static int SPLASH_WriteAt(uint32 offset, const void *pData, uint32 size)
+{
+	if(splash_stream_fd >= 0)
+		return SPLASH_WriteFile(splash_stream_fd, (splash_data_start_flash_address - FLASH_BASE_ADDRESS) + offset, pData, size);
+
+	if(SPLASH_ReserveBuffer(offset + size) < 0)
+		return ERROR_NO_MEM_FOR_MALLOC;
+	memcpy(splBuffer + offset, pData, size);
+	return 0;
+}
+
+/* Returns TRUE if the splash output holds the given data at the offset. A stream that can't be
+ * read back never matches. */
+static BOOL SPLASH_CompareAt(uint32 offset, const void *pData, uint32 size)
+{
+	unsigned char buffer[0x4000];
+	const unsigned char *p = (const unsigned char *)pData;
+	uint32 n;
 
-	lineLength = splash_header.Image_width * 3;
+	if(splash_stream_fd < 0)
+		return offset + size <= splash_index && memcmp(splBuffer + offset, pData, size) == 0;
 
-	lineData = (unsigned char *) malloc(lineLength);
-	for (i = 0; i < splash_header.Image_height; i++)
+	while(size > 0)
 	{
-		memcpy(lineData, image_buffer + (lineLength * i), lineLength);
-		for (j = 0;j < splash_header.Image_width; j++)
-		{
-			unsigned char tempByte;
+		n = MIN(size, sizeof(buffer));
+		if(SPLASH_ReadFile(splash_stream_fd, (splash_data_start_flash_address - FLASH_BASE_ADDRESS) + offset, buffer, n) < 0 ||
+			memcmp(buffer, p, n) != 0)
+			return FALSE;
+		p += n;
+		offset += n;
+		size -= n;
+	}
+	return TRUE;
+}
 
-			tempByte = lineData[j * 3 + 2];
-			lineData[j * 3 + 2] = lineData[j * 3 + 1];
-			lineData[j * 3 + 1] = tempByte;
-		}
-		memcpy(image_buffer + (lineLength * i), lineData, lineLength);
+static int SPLASH_FillAt(uint32 offset, uint32 size)
+{
+	static unsigned char erased[0x10000];
+	uint32 n;
+	int ret;
+
+	if(splash_stream_fd < 0)
+	{
+		if(SPLASH_ReserveBuffer(offset + size) < 0)
+			return ERROR_NO_MEM_FOR_MALLOC;
+		memset(splBuffer + offset, 0xFF, size);
+		return 0;
 	}
 
-	free(lineData);
-	memcpy(pImageBuffer, image_buffer, splash_image_size);
-	free(image_buffer);
-	
+	if(erased[0] != 0xFF)
+		memset(erased, 0xFF, sizeof(erased));
+	while(size > 0)
+	{
+		n = MIN(size, sizeof(erased));
+		ret = SPLASH_WriteAt(offset, erased, n);
+		if(ret < 0)
+			return ret;
+		offset += n;
+		size -= n;
+	}
 	return 0;
 }
 
+static SPLASH_BLOB_INFO *SPLASH_BlobInfo(int index)
+{
+	if(splash_stream_fd >= 0)
+		return &splash_stream_blobs[index];
+	return (SPLASH_BLOB_INFO *)(splBuffer + sizeof(SPLASH_SUPER_BINARY_INFO) + (index * sizeof(SPLASH_BLOB_INFO)));
+}
+
 int Frmw_SPLASH_InitBuffer(int numSplash)
 {
 	SPLASH_SUPER_BINARY_INFO	binary_info;
@@ -464,6 +781,12 @@ int Frmw_SPLASH_InitBuffer(int numSplash)
 	}
 	splash_index = 0;
 	splash_count = 0;
+	splash_stream_fd = -1;
+	splash_hash_count = 0;
+	splash_bytes_shared = 0;
+	splash_cache_hits = 0;
+	splash_cache_misses = 0;
+	memset(splash_load_times, 0, sizeof(splash_load_times));
 	
 	binary_info.Sig1 = 0x12345678;
 	binary_info.Sig2 = 0x87654321;
@@ -472,7 +795,10 @@ int Frmw_SPLASH_InitBuffer(int numSplash)
 	blob_info.BlobOffset = 0xFFFFFFFF;
 	blob_info.BlobSize   = 0xFFFFFFFF;
 
-	splBuffer = (unsigned char *) malloc(sizeof(binary_info) + (sizeof(blob_info) * numSplash));
+	splash_capacity = sizeof(binary_info) + (sizeof(blob_info) * numSplash);
+	splBuffer = (unsigned char *) malloc(splash_capacity);
+	if(splBuffer == NULL)
+		return ERROR_NO_MEM_FOR_MALLOC;
 
 	memcpy(splBuffer + splash_index, &binary_info, sizeof(binary_info));
 	splash_index += sizeof(binary_info);
@@ -485,36 +811,207 @@ int Frmw_SPLASH_InitBuffer(int numSplash)
 	return 0;
 }
 
-int Frmw_SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint32 *compSize)
+int Frmw_SPLASH_InitStream(int fd, int numSplash)
+/**
+ * Same as Frmw_SPLASH_InitBuffer, but the new firmware image is written to a file while the splash
+ * images are added instead of being collected in memory. The part of the loaded firmware image
+ * before the splash data is written first; the blob table is patched by Frmw_SPLASH_FinishStream.
+ * Identical images only share their data if the file is also open for reading.
+ *
+ * @param   fd - I - file descriptor opened for writing, owned by the caller
+ * @param   numSplash - I - number of splash images that will be added
+ *
+ * @return  0 = PASS, otherwise ERROR_xxx
+ *
+ */
 {
-	BITMAPFILEHEADER fileHeader;  
-	BITMAPINFOHEADER headerInfo;
-	unsigned char *bitmapImage, *line1Data, *line2Data, *splashImage, *rle_buffer;
-	int lineLength, bytesPerPixel, i, j;
-	uint32 splashSize;
-	SPLASH_HEADER splash_header;
-	SPLASH_BLOB_INFO *blob_info;
-	
-	if((!splBuffer || !splash_data_start_flash_address))
+	SPLASH_SUPER_BINARY_INFO	binary_info;
+	int ret;
+
+	if(!pFrmwImageArray || !splash_data_start_flash_address)
 		return ERROR_INIT_NOT_DONE_PROPERLY;
+	if(fd < 0 || numSplash < 0 || numSplash > MAX_SPLASH_IMAGES)
+		return ERROR_WRONG_PARAMS;
 
-	memcpy(&fileHeader, pImageBuffer, sizeof(fileHeader));
-	memcpy(&headerInfo, pImageBuffer + sizeof(fileHeader), sizeof(headerInfo));
+	if(splBuffer != NULL)
+	{
+		free(splBuffer);
+		splBuffer = NULL;
+	}
+	splash_index = 0;
+	splash_count = 0;
+	splash_capacity = 0;
+	splash_stream_fd = fd;
+	splash_stream_count = numSplash;
+	splash_hash_count = 0;
+	splash_bytes_shared = 0;
+	splash_cache_hits = 0;
+	splash_cache_misses = 0;
+	memset(splash_load_times, 0, sizeof(splash_load_times));
 
-	if (fileHeader.bfType != 0x4D42)  
-        	return ERROR_NOT_BMP_FILE;
-	if(headerInfo.biBitCount != 24)// && headerInfo.biBitCount != 32)
-		return ERROR_NOT_24bit_BMP_FILE;
+	binary_info.Sig1 = 0x12345678;
+	binary_info.Sig2 = 0x87654321;
+	binary_info.BlobCount = numSplash;
+	memset(splash_stream_blobs, 0xFF, sizeof(splash_stream_blobs));
+
+	ret = SPLASH_WriteFile(fd, 0, pFrmwImageArray, splash_data_start_flash_address - FLASH_BASE_ADDRESS);
+	if(ret == 0)
+		ret = SPLASH_WriteAt(0, &binary_info, sizeof(binary_info));
+	if(ret == 0)
+		ret = SPLASH_WriteAt(sizeof(binary_info), splash_stream_blobs, numSplash * sizeof(SPLASH_BLOB_INFO));
+	if(ret < 0)
+	{
+		splash_stream_fd = -1;
+		return ret;
+	}
+	splash_index = sizeof(binary_info) + numSplash * sizeof(SPLASH_BLOB_INFO);
+	return 0;
+}
 
-	bitmapImage = (unsigned char *)malloc(fileHeader.bfSize - fileHeader.bfOffBits);
-	if (!bitmapImage)
-		return ERROR_NO_MEM_FOR_MALLOC;
+int Frmw_SPLASH_FinishStream(uint32 *pImageSize)
+/**
+ * Completes the firmware image started by Frmw_SPLASH_InitStream by writing the blob table.
+ *
+ * @param   pImageSize - O - size of the firmware image written to the file
+ *
+ * @return  0 = PASS, otherwise ERROR_xxx
+ *
+ */
+{
+	int ret;
 
-	memcpy(bitmapImage, pImageBuffer + fileHeader.bfOffBits, fileHeader.bfSize - fileHeader.bfOffBits);
+	if(splash_stream_fd < 0)
+		return ERROR_INIT_NOT_DONE_PROPERLY;
 
-	bytesPerPixel = headerInfo.biBitCount / 8;
+	ret = SPLASH_WriteAt(sizeof(SPLASH_SUPER_BINARY_INFO), splash_stream_blobs, splash_stream_count * sizeof(SPLASH_BLOB_INFO));
+	splash_stream_fd = -1;
+	if(ret < 0)
+		return ret;
 
-        lineLength    =  headerInfo.biWidth * bytesPerPixel;
+	*pImageSize = (splash_data_start_flash_address - FLASH_BASE_ADDRESS) + splash_index;
+	return 0;
+}
+
+typedef struct
+{
+	unsigned char *pBitmap;		/* flipped and channel swapped image, freed by SPLASH_FreeImage */
+	unsigned char *pRle;		/* RLE buffer, freed by SPLASH_FreeImage */
+	unsigned char *pData;		/* points into pBitmap or pRle */
+	uint32 Size;
+	uint8 Compression;
+	SPLASH_HEADER Header;
+	unsigned long long Hash;	/* of the header and the data */
+} SPLASH_IMAGE;
+
+static void SPLASH_FreeImage(SPLASH_IMAGE *pImage)
+{
+	free(pImage->pRle);
+	free(pImage->pBitmap);
+	pImage->pRle = NULL;
+	pImage->pBitmap = NULL;
+	pImage->pData = NULL;
+}
+
+/* Fits load time = a + b * size to the samples of one compression. A fit that doesn't make sense,
+ * e.g. because all the samples have the same size, falls back to a time proportional to the size. */
+static int SPLASH_ModelFit(const SPLASH_LOAD_SAMPLES *pSamples, double *pA, double *pB)
+{
+	double n = pSamples->NumSamples, den;
+
+	if(pSamples->NumSamples == 0)
+		return -1;
+
+	den = n * pSamples->SumSizeSq - pSamples->SumSize * pSamples->SumSize;
+	if(pSamples->NumSamples >= 2 && den > 1e-9 * n * pSamples->SumSizeSq)
+	{
+		*pB = (n * pSamples->SumSizeTime - pSamples->SumSize * pSamples->SumTime) / den;
+		*pA = (pSamples->SumTime - *pB * pSamples->SumSize) / n;
+		if(*pB >= 0 && *pA >= 0)
+			return 0;
+	}
+
+	if(pSamples->SumSize > 0)
+	{
+		*pA = 0;
+		*pB = pSamples->SumTime / pSamples->SumSize;
+	}
+	else
+	{
+		*pA = pSamples->SumTime / n;
+		*pB = 0;
+	}
+	return 0;
+}
+
+/* Picks the compression of an image in auto mode from the data size of every candidate, 0 where the
+ * candidate isn't possible. Without a load policy the smallest image wins, 4-line first. With one,
+ * the smallest image predicted to load within the target wins, or the fastest if none does;
+ * compressions the model has no samples of aren't considered. */
+static uint8 SPLASH_ChooseCompression(const uint32 *pSizes)
+{
+	static const uint8 candidates[3] = {SPLASH_4LINE_COMPRESSION, SPLASH_RLE_COMPRESSION, SPLASH_UNCOMPRESSED};
+	uint32 loadTime, bestTime = 0, bestSize = 0;
+	BOOL meets, bestMeets = FALSE;
+	int i, best = -1;
+
+	if(splash_load_policy)
+	{
+		for(i = 0; i < 3; i++)
+		{
+			if(pSizes[candidates[i]] == 0 ||
+				Frmw_SPLASH_ModelPredict(&splash_load_model, candidates[i], pSizes[candidates[i]], &loadTime) < 0)
+				continue;
+
+			meets = loadTime <= splash_load_target;
+			if(best < 0 || (meets && (!bestMeets || pSizes[candidates[i]] < bestSize)) ||
+				(!meets && !bestMeets && loadTime < bestTime))
+			{
+				best = candidates[i];
+				bestMeets = meets;
+				bestSize = pSizes[candidates[i]];
+				bestTime = loadTime;
+			}
+		}
+		if(best >= 0)
+			return best;
+	}
+
+	if(pSizes[SPLASH_4LINE_COMPRESSION] != 0 && pSizes[SPLASH_4LINE_COMPRESSION] < pSizes[SPLASH_UNCOMPRESSED])
+		return SPLASH_4LINE_COMPRESSION;
+	if(pSizes[SPLASH_RLE_COMPRESSION] != 0)
+		return SPLASH_RLE_COMPRESSION;
+	return SPLASH_UNCOMPRESSED;
+}
+
+/* Decodes and compresses one BMP. Doesn't touch the splash buffer, so images can be prepared in parallel. */
+static int SPLASH_EncodeImage(const unsigned char *pImageBuffer, uint8 compression, SPLASH_IMAGE *pImage)
+{
+	BITMAPFILEHEADER fileHeader;  
+	BITMAPINFOHEADER headerInfo;
+	unsigned char *bitmapImage, *line1Data, *line2Data, *splashImage;
+	int lineLength, bytesPerPixel, i, j;
+	uint32 splashSize;
+	SPLASH_HEADER splash_header;
+
+	memset(pImage, 0, sizeof(*pImage));
+
+	memcpy(&fileHeader, pImageBuffer, sizeof(fileHeader));
+	memcpy(&headerInfo, pImageBuffer + sizeof(fileHeader), sizeof(headerInfo));
+
+	if (fileHeader.bfType != 0x4D42)  
+        	return ERROR_NOT_BMP_FILE;
+	if(headerInfo.biBitCount != 24)// && headerInfo.biBitCount != 32)
+		return ERROR_NOT_24bit_BMP_FILE;
+
+	bitmapImage = (unsigned char *)malloc(fileHeader.bfSize - fileHeader.bfOffBits);
+	if (!bitmapImage)
+		return ERROR_NO_MEM_FOR_MALLOC;
+
+	memcpy(bitmapImage, pImageBuffer + fileHeader.bfOffBits, fileHeader.bfSize - fileHeader.bfOffBits);
+
+	bytesPerPixel = headerInfo.biBitCount / 8;
+
+        lineLength    =  headerInfo.biWidth * bytesPerPixel;
 
 	if(lineLength % 4 != 0)
         {
@@ -564,16 +1061,11 @@ int Frmw_SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint3
 	free(line1Data); 
 	free(line2Data);
 	
-	unsigned char *rleBuffer = (unsigned char *)malloc((((headerInfo.biHeight * headerInfo.biWidth * bytesPerPixel) + 
-							  ((headerInfo.biHeight * headerInfo.biWidth * 4) / 255) + (headerInfo.biWidth * 2) + 15) - 1));
+	unsigned char *rleBuffer = NULL;
+	uint32 rleCompSize, candidateSizes[SPLASH_NOCOMP_SPECIFIED] = {0};
+	uint32 linePeriod;
 
-	if (rleBuffer == NULL)
-	{
-		free(bitmapImage);
-		return ERROR_NO_MEM_FOR_MALLOC;
-	}
-	
-	switch(*compression)
+	switch(compression)
 	{
 	case 0: // force uncompress
 		splashSize  = headerInfo.biHeight * lineLength;
@@ -581,6 +1073,12 @@ int Frmw_SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint3
 		break;
 
 	case 1: // force rle compress
+		rleBuffer = (unsigned char *)malloc(SPLASH_RLEMaxSize(headerInfo.biWidth, headerInfo.biHeight));
+		if (rleBuffer == NULL)
+		{
+			free(bitmapImage);
+			return ERROR_NO_MEM_FOR_MALLOC;
+		}
 		SPLASH_PerformRLECompression(bitmapImage, rleBuffer, headerInfo.biWidth, headerInfo.biHeight, &splashSize);
 		splashImage = rleBuffer;
 		break;
@@ -591,30 +1089,35 @@ int Frmw_SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint3
 		break;
 	
 	default: // auto compression
-		uint32 lineCompSize, rleCompSize;
-
-		SPLASH_PerformLineCompression(bitmapImage, headerInfo.biWidth, headerInfo.biHeight, &lineCompSize, 4);
-		SPLASH_PerformRLECompression(bitmapImage, rleBuffer, headerInfo.biWidth, headerInfo.biHeight, &rleCompSize);
-
-		splashSize  = headerInfo.biHeight * lineLength;
-
-		if(lineCompSize < splashSize)
+		/* Size both candidates in one pass; the RLE stream is only produced if it is the one used */
+		candidateSizes[SPLASH_UNCOMPRESSED] = headerInfo.biHeight * lineLength;
+		rleCompSize = SPLASH_EstimateCompression(bitmapImage, headerInfo.biWidth, headerInfo.biHeight, lineLength,
+							 SPLASH_4LINE_PERIOD, candidateSizes[SPLASH_UNCOMPRESSED], &linePeriod);
+		candidateSizes[SPLASH_RLE_COMPRESSION] = rleCompSize < candidateSizes[SPLASH_UNCOMPRESSED] ? rleCompSize : 0;
+		/* Periods of 1 and 2 lines repeat every 4 lines too, longer ones are left to RLE */
+		candidateSizes[SPLASH_4LINE_COMPRESSION] = linePeriod != 0 ? SPLASH_4LINE_PERIOD * lineLength : 0;
+		compression = SPLASH_ChooseCompression(candidateSizes);
+
+		if(compression == SPLASH_4LINE_COMPRESSION)
 		{
 			splashSize  = 4 * lineLength;
 			splashImage = bitmapImage;
-			*compression = 4;
 		}
-		else if(rleCompSize < splashSize)
+		else if(compression == SPLASH_RLE_COMPRESSION)
 		{
-			splashSize  = rleCompSize;
+			rleBuffer = (unsigned char *)malloc(rleCompSize);
+			if (rleBuffer == NULL)
+			{
+				free(bitmapImage);
+				return ERROR_NO_MEM_FOR_MALLOC;
+			}
+			SPLASH_PerformRLECompression(bitmapImage, rleBuffer, headerInfo.biWidth, headerInfo.biHeight, &splashSize);
 			splashImage = rleBuffer; 
-			*compression    = 1;
 		}
 		else
 		{
 			splashSize  = headerInfo.biHeight * lineLength;
 			splashImage = bitmapImage; 
-			*compression    = 0;
 		}
 
 		break;
@@ -630,9 +1133,181 @@ int Frmw_SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint3
 	splash_header.ByteOrder		= 1;
 	splash_header.ChromaOrder	= 0;
 	splash_header.Byte_count	= splashSize;
-	splash_header.Compression	= *compression;
+	splash_header.Compression	= compression;
+	memset(splash_header.Pad, 0, sizeof(splash_header.Pad));
+
+	pImage->pBitmap		= bitmapImage;
+	pImage->pRle		= rleBuffer;
+	pImage->pData		= splashImage;
+	pImage->Size		= splashSize;
+	pImage->Compression	= compression;
+	pImage->Header		= splash_header;
+	pImage->Hash		= CHKSUM_Hash64(splashImage, splashSize,
+						CHKSUM_Hash64((const uint8 *)&splash_header, sizeof(splash_header), 0));
+	return 0;
+}
+
+/* Same as SPLASH_EncodeImage, but takes the blob from the cache directory when the same BMP was
+ * compressed before with the same requested compression, and adds newly compressed blobs to it. */
+static int SPLASH_PrepareImage(const unsigned char *pImageBuffer, uint8 compression, SPLASH_IMAGE *pImage)
+{
+	BITMAPFILEHEADER fileHeader;
+	unsigned char *pBlob;
+	uint32 blobSize, tag;
+	unsigned long long blobHash;
+	int ret;
+
+	memcpy(&fileHeader, pImageBuffer, sizeof(fileHeader));
+	if(splash_cache_dir[0] == 0 || fileHeader.bfType != 0x4D42)
+		return SPLASH_EncodeImage(pImageBuffer, compression, pImage);
+
+	tag = (SPLASH_ENCODER_VERSION << 8) | compression;
+	if(splash_load_policy && compression == SPLASH_NOCOMP_SPECIFIED)
+	{
+		/* The choice depends on the policy, blobs chosen with another one are different entries */
+		tag = CHKSUM_Crc32Update(tag, (const uint8 *)&splash_load_model, sizeof(splash_load_model));
+		tag = CHKSUM_Crc32Update(tag, (const uint8 *)&splash_load_target, sizeof(splash_load_target));
+	}
+	if(SPLCACHE_Lookup(splash_cache_dir, pImageBuffer, fileHeader.bfSize, tag, &pBlob, &blobSize, &blobHash) == 0)
+	{
+		/* Stored as the header followed by the data, so the blob hash is the image hash */
+		if(blobSize >= sizeof(SPLASH_HEADER))
+		{
+			memset(pImage, 0, sizeof(*pImage));
+			memcpy(&pImage->Header, pBlob, sizeof(SPLASH_HEADER));
+			pImage->pRle		= pBlob;
+			pImage->pData		= pBlob + sizeof(SPLASH_HEADER);
+			pImage->Size		= blobSize - sizeof(SPLASH_HEADER);
+			pImage->Compression	= pImage->Header.Compression;
+			pImage->Hash		= blobHash;
+			THREAD_AtomicIncrement(&splash_cache_hits);
+			return 0;
+		}
+		free(pBlob);
+	}
+
+	THREAD_AtomicIncrement(&splash_cache_misses);
+	ret = SPLASH_EncodeImage(pImageBuffer, compression, pImage);
+	if(ret == 0)
+	{
+		/* A blob that can't be stored is compressed again by the next build */
+		SPLCACHE_Store(splash_cache_dir, pImageBuffer, fileHeader.bfSize, tag, (const uint8 *)&pImage->Header,
+				sizeof(SPLASH_HEADER), pImage->pData, pImage->Size);
+	}
+	return ret;
+}
+
+/* Records the load time of a blob predicted by the model of the load policy */
+static void SPLASH_PredictLoadTime(const SPLASH_IMAGE *pImage, int index)
+{
+	uint32 loadTime;
+
+	if(!splash_load_policy || index >= MAX_SPLASH_IMAGES ||
+		Frmw_SPLASH_ModelPredict(&splash_load_model, pImage->Compression, pImage->Size, &loadTime) < 0)
+		return;
+
+	splash_load_times[index] = loadTime;
+}
+
+/* Writes the header and data of a prepared image at a splash buffer offset and points the blob table entry at it */
+static int SPLASH_WriteBlob(const SPLASH_IMAGE *pImage, int index, uint32 offset)
+{
+	SPLASH_BLOB_INFO *blob_info;
+	int ret;
+
+	blob_info = SPLASH_BlobInfo(index);
+	blob_info->BlobOffset = offset + splash_data_start_flash_address;
+	blob_info->BlobSize   = sizeof(SPLASH_HEADER) + pImage->Size;
+
+	/* check if it is crossing the 3rd chipselect, if yes remap it to 0th chip select */
+	if(blob_info->BlobOffset >= FLASH_THREE_ADDRESS)
+	{
+		blob_info->BlobOffset -= 0x03000000;
+	}
+
+	ret = SPLASH_WriteAt(offset, &pImage->Header, sizeof(SPLASH_HEADER));
+	if(ret < 0)
+		return ret;
+
+	ret = SPLASH_WriteAt(offset + sizeof(SPLASH_HEADER), pImage->pData, pImage->Size);
+	if(ret < 0)
+		return ret;
+
+	SPLASH_PredictLoadTime(pImage, index);
+
+	if(splash_hash_count < MAX_SPLASH_IMAGES)
+	{
+		splash_hashes[splash_hash_count].Hash = pImage->Hash;
+		splash_hashes[splash_hash_count].Index = index;
+		splash_hash_count++;
+	}
+	return 0;
+}
 
-	blob_info = (SPLASH_BLOB_INFO *)(splBuffer + sizeof(SPLASH_SUPER_BINARY_INFO) + (splash_count * sizeof(SPLASH_BLOB_INFO)));
+static BOOL SPLASH_SameImage(const SPLASH_IMAGE *pImage1, const SPLASH_IMAGE *pImage2)
+{
+	return pImage1->Hash == pImage2->Hash && pImage1->Size == pImage2->Size &&
+		memcmp(&pImage1->Header, &pImage2->Header, sizeof(SPLASH_HEADER)) == 0 &&
+		memcmp(pImage1->pData, pImage2->pData, pImage1->Size) == 0;
+}
+
+/* Returns the blob table index of a blob already written with the same header and data, -1 if none */
+static int SPLASH_FindBlob(const SPLASH_IMAGE *pImage)
+{
+	const SPLASH_BLOB_INFO *blob_info;
+	uint32 offset;
+	int i;
+
+	for(i = 0; i < splash_hash_count; i++)
+	{
+		if(splash_hashes[i].Hash != pImage->Hash)
+			continue;
+
+		blob_info = SPLASH_BlobInfo(splash_hashes[i].Index);
+		if(blob_info->BlobSize != sizeof(SPLASH_HEADER) + pImage->Size)
+			continue;
+
+		offset = blob_info->BlobOffset;
+		if(offset < FLASH_BASE_ADDRESS)
+			offset += 0x03000000;
+		offset -= splash_data_start_flash_address;
+
+		/* The hash only narrows the search, the blob must match byte for byte */
+		if(SPLASH_CompareAt(offset, &pImage->Header, sizeof(SPLASH_HEADER)) &&
+			SPLASH_CompareAt(offset + sizeof(SPLASH_HEADER), pImage->pData, pImage->Size))
+			return splash_hashes[i].Index;
+	}
+	return -1;
+}
+
+/* Points a blob table entry at the data of an identical blob instead of writing another copy */
+static void SPLASH_ShareBlob(int index, int source)
+{
+	SPLASH_BLOB_INFO *blob_info = SPLASH_BlobInfo(index);
+
+	*blob_info = *SPLASH_BlobInfo(source);
+	splash_bytes_shared += blob_info->BlobSize;
+	if(index < MAX_SPLASH_IMAGES && source < MAX_SPLASH_IMAGES)
+		splash_load_times[index] = splash_load_times[source];
+}
+
+/* Appends a prepared image to the splash output, moving to the next chip select when it doesn't fit */
+static int SPLASH_PlaceImage(const SPLASH_IMAGE *pImage)
+{
+	SPLASH_HEADER splash_header = pImage->Header;
+	uint32 splashSize = pImage->Size;
+	int ret;
+
+	if(splash_stream_fd >= 0 && splash_count >= MAX_SPLASH_IMAGES)
+		return ERROR_WRONG_PARAMS;
+
+	int source = SPLASH_FindBlob(pImage);
+	if(source >= 0)
+	{
+		SPLASH_ShareBlob(splash_count, source);
+		splash_count++;
+		return 0;
+	}
 
 	uint32 FlashEnd, currChipSelect, nextChipSelect;
 
@@ -675,48 +1350,895 @@ int Frmw_SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint3
 			printf("BYTES UNUSED IN FLASH_CS%d = 0x%08X <%d> bytes\n", currChipSelect, ChipSelectEnd[currChipSelect] -
 						splash_data_start_flash_address - splash_index, ChipSelectEnd[currChipSelect] - splash_data_start_flash_address - splash_index);
 
-			splBuffer = (unsigned char *)realloc(splBuffer, ChipSelectBase[nextChipSelect] - splash_data_start_flash_address);
-
-			memset(splBuffer + splash_index, 0xFF, ChipSelectBase[nextChipSelect] - splash_data_start_flash_address - splash_index);
+			ret = SPLASH_FillAt(splash_index, ChipSelectBase[nextChipSelect] - splash_data_start_flash_address - splash_index);
+			if(ret < 0)
+				return ret;
 
 			splash_index = ChipSelectBase[nextChipSelect] - splash_data_start_flash_address;
+		}
+		ret = SPLASH_WriteBlob(pImage, splash_count, splash_index);
+		if(ret < 0)
+			return ret;
+
+		splash_index += sizeof(splash_header) + splashSize;
+		splash_count++;
+	}
+	else
+	{
+		splash_count++;
+
+		printf("NO SPACE LEFT IN THE FLASH CAN'T WRITE SPLASH [%d]\n", splash_count);
+	}
+	return 0;
+}
+
+int Frmw_SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint32 *compSize)
+{
+	SPLASH_IMAGE image;
+	int ret;
+
+	if(((!splBuffer && splash_stream_fd < 0) || !splash_data_start_flash_address))
+		return ERROR_INIT_NOT_DONE_PROPERLY;
+
+	ret = SPLASH_PrepareImage(pImageBuffer, *compression, &image);
+	if(ret < 0)
+		return ret;
+
+	ret = SPLASH_PlaceImage(&image);
+
+	*compression = image.Compression;
+	*compSize = image.Size;
+	SPLASH_FreeImage(&image);
+	return ret;
+}
+
+typedef struct
+{
+	unsigned char **ppImageBuffers;
+	uint8 *pCompression;
+	SPLASH_IMAGE *pImages;
+	int *pResults;
+} SPLASH_BATCH;
+
+static void SPLASH_PrepareTask(void *pContext, unsigned int index)
+{
+	SPLASH_BATCH *pBatch = (SPLASH_BATCH *)pContext;
+
+	pBatch->pResults[index] = SPLASH_PrepareImage(pBatch->ppImageBuffers[index], pBatch->pCompression[index],
+							&pBatch->pImages[index]);
+}
 
-			blob_info = (SPLASH_BLOB_INFO *)(splBuffer + sizeof(SPLASH_SUPER_BINARY_INFO) + (splash_count * sizeof(SPLASH_BLOB_INFO)));
+/* Decodes and compresses a batch of images in parallel. On success the caller frees the images. */
+static int SPLASH_PrepareBatch(unsigned char **ppImageBuffers, int numImages, uint8 *pCompression, int numThreads, SPLASH_IMAGE **ppImages)
+{
+	SPLASH_BATCH batch;
+	int i, ret = 0;
+
+	batch.ppImageBuffers = ppImageBuffers;
+	batch.pCompression = pCompression;
+	batch.pImages = (SPLASH_IMAGE *)calloc(numImages, sizeof(SPLASH_IMAGE));
+	batch.pResults = (int *)malloc(numImages * sizeof(int));
+	if(batch.pImages == NULL || batch.pResults == NULL)
+	{
+		free(batch.pImages);
+		free(batch.pResults);
+		return ERROR_NO_MEM_FOR_MALLOC;
+	}
+
+	THREAD_ParallelFor(numImages, SPLASH_PrepareTask, &batch, numThreads);
+
+	for(i = 0; i < numImages; i++)
+	{
+		if(batch.pResults[i] < 0)
+		{
+			ret = batch.pResults[i];
+			break;
 		}
-		blob_info->BlobOffset = splash_index + splash_data_start_flash_address;
-		blob_info->BlobSize   = sizeof(splash_header) + splashSize;
+	}
+	free(batch.pResults);
+
+	if(ret < 0)
+	{
+		for(i = 0; i < numImages; i++)
+			SPLASH_FreeImage(&batch.pImages[i]);
+		free(batch.pImages);
+		return ret;
+	}
+
+	*ppImages = batch.pImages;
+	return 0;
+}
+
+int Frmw_SPLASH_AddSplashBatch(unsigned char **ppImageBuffers, int numImages, uint8 *pCompression, uint32 *pCompSize, int numThreads)
+/**
+ * Adds several splash images, same as calling Frmw_SPLASH_AddSplash for each of them in order.
+ * The images are decoded and compressed in parallel, then laid out in the flash one after the
+ * other, so the splash buffer doesn't depend on the number of threads.
+ *
+ * @param   ppImageBuffers - I - BMP files
+ * @param   numImages - I - number of images
+ * @param   pCompression - I/O - compression of each image, see Frmw_SPLASH_AddSplash
+ * @param   pCompSize - O - size of each compressed image
+ * @param   numThreads - I - 0 = one per processor
+ *
+ * @return  0 = PASS, otherwise the error of the first image that failed. If an image can't be
+ *          decoded nothing is added.
+ *
+ */
+{
+	SPLASH_IMAGE *pImages;
+	int i, ret;
+
+	if(((!splBuffer && splash_stream_fd < 0) || !splash_data_start_flash_address))
+		return ERROR_INIT_NOT_DONE_PROPERLY;
+	if(numImages < 0 || splash_count + numImages > MAX_SPLASH_IMAGES || numThreads < 0)
+		return ERROR_WRONG_PARAMS;
+	if(numImages == 0)
+		return 0;
+
+	ret = SPLASH_PrepareBatch(ppImageBuffers, numImages, pCompression, numThreads, &pImages);
+	if(ret < 0)
+		return ret;
 
-		/* check if it is crossing the 3rd chipselect, if yes remap it to 0th chip select */
-		if(blob_info->BlobOffset >= FLASH_THREE_ADDRESS)
+	for(i = 0; i < numImages; i++)
+	{
+		if(ret == 0)
 		{
-			blob_info->BlobOffset -= 0x03000000;
+			ret = SPLASH_PlaceImage(&pImages[i]);
+			pCompression[i] = pImages[i].Compression;
+			pCompSize[i] = pImages[i].Size;
 		}
+		SPLASH_FreeImage(&pImages[i]);
+	}
 
-		splBuffer = (unsigned char *)realloc(splBuffer, splash_index + sizeof(splash_header) + splashSize);
+	free(pImages);
+	return ret;
+}
 
-		memcpy(splBuffer + splash_index, &splash_header, sizeof(splash_header));
-		
-		splash_index += sizeof(splash_header);
+typedef struct
+{
+	uint32 Start;		/* flash addresses */
+	uint32 End;
+	int ChipSelect;		/* first chip select of the region */
+} SPLASH_REGION;
+
+/* Lists the address ranges splash blobs can be placed in from a flash address on, in flash
+ * order. A full size CS1 continues into CS2 as in SPLASH_PlaceImage. CS0 is remapped, so no blob
+ * may cross into it. */
+static int SPLASH_GetRegions(uint32 position, SPLASH_REGION *pRegions)
+{
+	static const int order[3] = {1, 2, 0};
+	int i, cs, numRegions = 0;
 
-		memcpy(splBuffer + splash_index, splashImage, splashSize);
+	for(i = 0; i < 3; i++)
+	{
+		cs = order[i];
+		ChipSelectEnd[cs] = ChipSelectBase[cs] + ChipSelectSize[cs];
+		if(ChipSelectSize[cs] == 0 || ChipSelectEnd[cs] <= position)
+			continue;
 
-		splash_index += splashSize;
+		if(numRegions > 0 && cs == 2 && pRegions[numRegions - 1].ChipSelect == 1 && ChipSelectSize[1] == 0x01000000)
+		{
+			pRegions[numRegions - 1].End = ChipSelectEnd[cs];
+			continue;
+		}
 
-		splash_count++;
+		pRegions[numRegions].Start = MAX(ChipSelectBase[cs], position);
+		pRegions[numRegions].End = ChipSelectEnd[cs];
+		pRegions[numRegions].ChipSelect = cs;
+		numRegions++;
+	}
+	return numRegions;
+}
+
+#define SPLASH_PACK_UNIT		256	/* granularity of the region fill search in bytes */
+#define SPLASH_REGION_SHARED		3	/* region of a blob sharing the data of an identical one */
+
+/* Assigns to the region the unassigned blobs whose total size comes closest to its capacity
+ * (subset sum over SPLASH_PACK_UNIT units, sizes rounded up). Returns the number of blobs assigned. */
+static int SPLASH_FillRegion(const SPLASH_IMAGE *pImages, int numImages, int *pRegion, int region, uint32 capacity)
+{
+	int *pFrom;
+	uint32 units, c, w, best = 0;
+	int i, count = 0;
+
+	units = capacity / SPLASH_PACK_UNIT;
+	pFrom = (int *)malloc((units + 1) * sizeof(int));
+	if(pFrom == NULL)
+		return ERROR_NO_MEM_FOR_MALLOC;
+
+	/* pFrom[c] = blob completing the first subset found with c units, -1 if none */
+	pFrom[0] = numImages;
+	for(c = 1; c <= units; c++)
+		pFrom[c] = -1;
+
+	for(i = 0; i < numImages; i++)
+	{
+		if(pRegion[i] >= 0)
+			continue;
+		w = (sizeof(SPLASH_HEADER) + pImages[i].Size + SPLASH_PACK_UNIT - 1) / SPLASH_PACK_UNIT;
+		for(c = units; c >= w && c > 0; c--)
+		{
+			if(pFrom[c] < 0 && pFrom[c - w] >= 0)
+			{
+				pFrom[c] = i;
+				best = MAX(best, c);
+			}
+		}
+	}
+
+	/* The blob completing a sum was added after every blob of the rest of the sum */
+	for(c = best; c > 0; c -= w)
+	{
+		i = pFrom[c];
+		w = (sizeof(SPLASH_HEADER) + pImages[i].Size + SPLASH_PACK_UNIT - 1) / SPLASH_PACK_UNIT;
+		pRegion[i] = region;
+		count++;
 	}
+
+	free(pFrom);
+	return count;
+}
+
+int Frmw_SPLASH_AddSplashPacked(unsigned char **ppImageBuffers, int numImages, uint8 *pCompression, uint32 *pCompSize, int numThreads)
+/**
+ * Adds several splash images like Frmw_SPLASH_AddSplashBatch, but plans the layout with all the
+ * compressed sizes known instead of placing the images in arrival order. Each chip select, in
+ * flash order, gets the set of remaining blobs that fills it best, so little padding is left at
+ * its end and images that would overflow the flash when placed in order still fit. Blobs sharing
+ * a chip select keep their blob table order, and the blob table indices are the same as with the
+ * other calls. Images identical to one already added or earlier in the batch take no space.
+ * Frmw_SPLASH_GetUsage reports the resulting utilization.
+ *
+ * @param   ppImageBuffers - I - BMP files
+ * @param   numImages - I - number of images
+ * @param   pCompression - I/O - compression of each image, see Frmw_SPLASH_AddSplash
+ * @param   pCompSize - O - size of each compressed image
+ * @param   numThreads - I - 0 = one per processor
+ *
+ * @return  0 = PASS <BR>
+ *          ERROR_NO_FLASH_SPACE = the images don't fit, nothing is added <BR>
+ *          otherwise the error of the first image that failed, nothing is added <BR>
+ *
+ */
+{
+	SPLASH_REGION regions[3];
+	SPLASH_IMAGE *pImages;
+	SPLASH_BLOB_INFO *blob_info;
+	int *pRegion, *pSource = NULL;
+	uint32 total, position, startIndex;
+	int i, j, r, numRegions, remaining = 0, startHashCount, ret;
+
+	if(((!splBuffer && splash_stream_fd < 0) || !splash_data_start_flash_address))
+		return ERROR_INIT_NOT_DONE_PROPERLY;
+	if(numImages < 0 || splash_count + numImages > MAX_SPLASH_IMAGES || numThreads < 0)
+		return ERROR_WRONG_PARAMS;
+	if(numImages == 0)
+		return 0;
+
+	ret = SPLASH_PrepareBatch(ppImageBuffers, numImages, pCompression, numThreads, &pImages);
+	if(ret < 0)
+		return ret;
+
+	/* pSource: blob table index of the identical blob an image shares, -1 if it gets its own */
+	pRegion = (int *)malloc(2 * numImages * sizeof(int));
+	if(pRegion == NULL)
+		ret = ERROR_NO_MEM_FOR_MALLOC;
 	else
+		pSource = pRegion + numImages;
+
+	startIndex = splash_index;
+	startHashCount = splash_hash_count;
+	numRegions = SPLASH_GetRegions(splash_data_start_flash_address + splash_index, regions);
+	for(i = 0; ret == 0 && i < numImages; i++)
 	{
-		splash_count++;
+		pRegion[i] = -1;
+		pSource[i] = SPLASH_FindBlob(&pImages[i]);
+		for(j = 0; pSource[i] < 0 && j < i; j++)
+		{
+			if(pSource[j] < 0 && SPLASH_SameImage(&pImages[i], &pImages[j]))
+				pSource[i] = splash_count + j;
+		}
+		if(pSource[i] < 0)
+			remaining++;
+		else
+			pRegion[i] = SPLASH_REGION_SHARED;
+	}
 
-		printf("NO SPACE LEFT IN THE FLASH CAN'T WRITE SPLASH [%d]\n", splash_count);
+	/* Fill the regions in flash order, each with the blobs that leave the least space unused.
+	 * Once the remaining blobs fit they all go into the current region. */
+	for(r = 0; ret == 0 && r < numRegions && remaining > 0; r++)
+	{
+		for(i = 0, total = 0; i < numImages; i++)
+		{
+			if(pRegion[i] < 0)
+				total += sizeof(SPLASH_HEADER) + pImages[i].Size;
+		}
+
+		if(total <= regions[r].End - regions[r].Start)
+		{
+			for(i = 0; i < numImages; i++)
+			{
+				if(pRegion[i] < 0)
+					pRegion[i] = r;
+			}
+			remaining = 0;
+		}
+		else
+		{
+			ret = SPLASH_FillRegion(pImages, numImages, pRegion, r, regions[r].End - regions[r].Start);
+			if(ret > 0)
+			{
+				remaining -= ret;
+				ret = 0;
+			}
+		}
 	}
 
-	free(rleBuffer);
-	free(bitmapImage);
-	*compSize = splashSize;
+	if(ret == 0 && remaining > 0)
+	{
+		printf("NO SPACE LEFT IN THE FLASH CAN'T WRITE %d SPLASH IMAGES\n", remaining);
+		ret = ERROR_NO_FLASH_SPACE;
+	}
+
+	/* Write the regions in flash order, padding the gaps before each one used */
+	for(r = 0; ret == 0 && r < numRegions; r++)
+	{
+		for(i = 0; i < numImages && pRegion[i] != r; i++)
+			;
+		if(i == numImages)
+			continue;
+
+		position = regions[r].Start - splash_data_start_flash_address;
+		if(position > splash_index)
+		{
+			ret = SPLASH_FillAt(splash_index, position - splash_index);
+			splash_index = position;
+		}
+
+		for(i = 0; ret == 0 && i < numImages; i++)
+		{
+			if(pRegion[i] != r)
+				continue;
+			ret = SPLASH_WriteBlob(&pImages[i], splash_count + i, splash_index);
+			splash_index += sizeof(SPLASH_HEADER) + pImages[i].Size;
+		}
+	}
+
+	if(ret == 0)
+	{
+		for(i = 0; i < numImages; i++)
+		{
+			if(pSource[i] >= 0)
+				SPLASH_ShareBlob(splash_count + i, pSource[i]);
+			pCompression[i] = pImages[i].Compression;
+			pCompSize[i] = pImages[i].Size;
+		}
+		splash_count += numImages;
+	}
+	else
+	{
+		/* Nothing is added: forget the blobs written before the failure, the next ones overwrite their data */
+		splash_index = startIndex;
+		splash_hash_count = startHashCount;
+		for(i = 0; i < numImages; i++)
+		{
+			blob_info = SPLASH_BlobInfo(splash_count + i);
+			blob_info->BlobOffset = 0xFFFFFFFF;
+			blob_info->BlobSize = 0xFFFFFFFF;
+			splash_load_times[splash_count + i] = 0;
+		}
+	}
+
+	for(i = 0; i < numImages; i++)
+		SPLASH_FreeImage(&pImages[i]);
+	free(pImages);
+	free(pRegion);
+	return ret;
+}
+
+int Frmw_SPLASH_GetUsage(SPLASH_CS_USAGE *pUsage)
+/**
+ * Reports how much of each chip select the splash images added so far take.
+ *
+ * @param   pUsage - O - usage of CS0, CS1 and CS2, indexed by chip select
+ *
+ * @return  0 = PASS, otherwise ERROR_xxx
+ *
+ */
+{
+	const SPLASH_BLOB_INFO *blob_info;
+	uint32 address, start, end, written, dataStart, numSlots;
+	int i, j, cs;
+
+	if(((!splBuffer && splash_stream_fd < 0) || !splash_data_start_flash_address))
+		return ERROR_INIT_NOT_DONE_PROPERLY;
+
+	/* The blob table in front of the splash data isn't available for blobs */
+	numSlots = splash_stream_fd >= 0 ? splash_stream_count : ((SPLASH_SUPER_BINARY_INFO *)splBuffer)->BlobCount;
+	dataStart = splash_data_start_flash_address + sizeof(SPLASH_SUPER_BINARY_INFO) + numSlots * sizeof(SPLASH_BLOB_INFO);
+	end = splash_data_start_flash_address + splash_index;
+
+	for(cs = 0; cs < 3; cs++)
+	{
+		ChipSelectEnd[cs] = ChipSelectBase[cs] + ChipSelectSize[cs];
+		start = MAX(ChipSelectBase[cs], dataStart);
+		pUsage[cs].Capacity = ChipSelectEnd[cs] > start ? ChipSelectEnd[cs] - start : 0;
+		pUsage[cs].Used = 0;
+		pUsage[cs].Padding = 0;
+		pUsage[cs].Shared = 0;
+		pUsage[cs].NumBlobs = 0;
+	}
+
+	for(i = 0; i < splash_count; i++)
+	{
+		blob_info = SPLASH_BlobInfo(i);
+		if(blob_info->BlobOffset == 0xFFFFFFFF)
+			continue;
+
+		address = blob_info->BlobOffset;
+		if(address < FLASH_BASE_ADDRESS)
+			address += 0x03000000;
+		for(cs = 0; cs < 3; cs++)
+		{
+			if(address >= ChipSelectBase[cs] && address < ChipSelectEnd[cs])
+			{
+				/* A blob sharing the data of an earlier one takes no space of its own */
+				for(j = 0; j < i && SPLASH_BlobInfo(j)->BlobOffset != blob_info->BlobOffset; j++)
+					;
+				if(j < i)
+					pUsage[cs].Shared += blob_info->BlobSize;
+				else
+					pUsage[cs].Used += blob_info->BlobSize;
+				pUsage[cs].NumBlobs++;
+				break;
+			}
+		}
+	}
+
+	/* Padding: space written up to the end of the splash data that holds no blob */
+	for(cs = 0; cs < 3; cs++)
+	{
+		start = MAX(ChipSelectBase[cs], dataStart);
+		written = (pUsage[cs].Capacity > 0 && end > start) ? MIN(end, ChipSelectEnd[cs]) - start : 0;
+		pUsage[cs].Padding = written > pUsage[cs].Used ? written - pUsage[cs].Used : 0;
+	}
+	return 0;
+}
+
+int Frmw_SPLASH_SetCacheDir(const char *path)
+/**
+ * Keeps the compressed splash blobs in a directory so later builds only compress the images that
+ * changed. Blobs are looked up by the content of the BMP file and the requested compression, so
+ * the cache can be shared by several builds and firmware images.
+ *
+ * @param   path - I - cache directory, created if missing. NULL or "" disables the cache.
+ *
+ * @return  0 = PASS, otherwise ERROR_xxx
+ *
+ */
+{
+	if(path == NULL || path[0] == 0)
+	{
+		splash_cache_dir[0] = 0;
+		return 0;
+	}
+
+	if(strlen(path) >= sizeof(splash_cache_dir) - 32 || SPLCACHE_Init(path) < 0)
+		return ERROR_WRONG_PARAMS;
+
+	strcpy(splash_cache_dir, path);
+	return 0;
+}
+
+void Frmw_SPLASH_GetCacheStats(uint32 *pHits, uint32 *pMisses)
+/**
+ * Reports how many splash images of the current build came from the cache set with
+ * Frmw_SPLASH_SetCacheDir and how many had to be compressed.
+ *
+ * @param   pHits - O - images taken from the cache
+ * @param   pMisses - O - images compressed
+ *
+ */
+{
+	*pHits = THREAD_AtomicLoad(&splash_cache_hits);
+	*pMisses = THREAD_AtomicLoad(&splash_cache_misses);
+}
+
+uint32 Frmw_SPLASH_GetBytesShared(void)
+/**
+ * Reports the flash space saved in the current build by splash images identical to an earlier one,
+ * which point at its data instead of storing another copy.
+ *
+ * @return  bytes saved
+ *
+ */
+{
+	return splash_bytes_shared;
+}
+
+void Frmw_SPLASH_ModelInit(SPLASH_LOAD_MODEL *pModel)
+/**
+ * Starts a splash load time model without samples.
+ *
+ */
+{
+	memset(pModel, 0, sizeof(SPLASH_LOAD_MODEL));
+}
+
+int Frmw_SPLASH_ModelAddSample(SPLASH_LOAD_MODEL *pModel, uint8 compression, uint32 size, uint32 loadTime)
+/**
+ * Adds a measured load time to a splash load time model. The load time of every compression is
+ * modeled as a fixed time plus a time per byte of image data, fitted to the samples by least
+ * squares. All load times of the model are in microseconds, as returned by LCR_GetSplashLoadTime,
+ * which converts the raw LCR_ReadSplashLoadTiming values.
+ *
+ * @param   pModel - I/O - model
+ * @param   compression - I - compression of the image, SPLASH_UNCOMPRESSED, SPLASH_RLE_COMPRESSION or SPLASH_4LINE_COMPRESSION
+ * @param   size - I - size of the image data in bytes, without the splash header
+ * @param   loadTime - I - load time in microseconds
+ *
+ * @return  0 = PASS, otherwise ERROR_xxx
+ *
+ */
+{
+	SPLASH_LOAD_SAMPLES *pSamples;
+
+	if(!SPLASH_VALID_COMPRESSION(compression))
+		return ERROR_WRONG_PARAMS;
+
+	pSamples = &pModel->Samples[compression];
+	pSamples->NumSamples++;
+	pSamples->SumSize += size;
+	pSamples->SumTime += loadTime;
+	pSamples->SumSizeSq += (double)size * size;
+	pSamples->SumSizeTime += (double)size * loadTime;
+	return 0;
+}
+
+int Frmw_SPLASH_ModelAddTimings(SPLASH_LOAD_MODEL *pModel, const SPLASH_INDEX *pIndex, const uint32 *pLoadTimes, int numImages)
+/**
+ * Adds the load times measured for the splash images of a firmware image, e.g. with
+ * LCR_SplashTimingProfile and read back with LCR_GetSplashLoadTime, to a splash load time model.
+ * The compression and size of every image come from the firmware image.
+ *
+ * @param   pModel - I/O - model
+ * @param   pIndex - I - index of the firmware image the load times were measured with
+ * @param   pLoadTimes - I - load time of every splash image in microseconds, 0 if not measured
+ * @param   numImages - I - number of load times
+ *
+ * @return  number of samples added
+ *
+ */
+{
+	const SPLASH_INDEX_ENTRY *entry;
+	int i, count = 0;
+
+	for(i = 0; i < numImages; i++)
+	{
+		entry = Frmw_SplashIndexGet(pIndex, i);
+		if(entry == NULL || pLoadTimes[i] == 0)
+			continue;
+		if(Frmw_SPLASH_ModelAddSample(pModel, entry->Compression, entry->Size, pLoadTimes[i]) == 0)
+			count++;
+	}
+	return count;
+}
+
+int Frmw_SPLASH_ModelPredict(const SPLASH_LOAD_MODEL *pModel, uint8 compression, uint32 size, uint32 *pLoadTime)
+/**
+ * Predicts the load time of a splash image from a splash load time model.
+ *
+ * @param   pModel - I - model
+ * @param   compression - I - compression of the image
+ * @param   size - I - size of the image data in bytes, without the splash header
+ * @param   pLoadTime - O - load time in microseconds
+ *
+ * @return  0 = PASS <BR>
+ *          ERROR_WRONG_PARAMS = the model has no samples of this compression <BR>
+ *
+ */
+{
+	double a, b, loadTime;
+
+	if(!SPLASH_VALID_COMPRESSION(compression) || SPLASH_ModelFit(&pModel->Samples[compression], &a, &b) < 0)
+		return ERROR_WRONG_PARAMS;
+
+	loadTime = a + b * size + 0.5;
+	*pLoadTime = loadTime < 4294967295.0 ? (uint32)loadTime : 0xFFFFFFFF;
+	return 0;
+}
+
+int Frmw_SPLASH_SetLoadPolicy(const SPLASH_LOAD_MODEL *pModel, uint32 targetTime)
+/**
+ * Makes the auto compression (SPLASH_NOCOMP_SPECIFIED) pick, for every image, the smallest of the
+ * 4-line, RLE and uncompressed encodings the model predicts to load within the target time,
+ * instead of the smallest encoding. If none does, the one predicted to load fastest is used.
+ * The predicted load time of every image added is reported and kept, see Frmw_SPLASH_GetLoadTime.
+ *
+ * @param   pModel - I - load time model, copied. NULL goes back to picking the smallest encoding.
+ * @param   targetTime - I - load time to meet in microseconds
+ *
+ * @return  0 = PASS
+ *
+ */
+{
+	splash_load_policy = pModel != NULL;
+	if(pModel != NULL)
+		splash_load_model = *pModel;
+	else
+		Frmw_SPLASH_ModelInit(&splash_load_model);
+	splash_load_target = pModel != NULL ? targetTime : 0;
+	return 0;
+}
+
+int Frmw_SPLASH_GetLoadTime(int index, uint32 *pLoadTime)
+/**
+ * Returns the load time predicted for a splash image of the current build with the model set
+ * with Frmw_SPLASH_SetLoadPolicy.
+ *
+ * @param   index - I - splash image index
+ * @param   pLoadTime - O - load time in microseconds
+ *
+ * @return  0 = PASS <BR>
+ *          ERROR_NO_SPLASH_IMAGE = no prediction for this image <BR>
+ *
+ */
+{
+	if(index < 0 || index >= MAX_SPLASH_IMAGES || splash_load_times[index] == 0)
+		return ERROR_NO_SPLASH_IMAGE;
+
+	*pLoadTime = splash_load_times[index];
+	return 0;
+}
+
+/* Adds a range of the image to the list of changed ranges, merging it with the ranges it touches */
+static int SPLASH_AddChanged(FLASH_BLOCK *pChanged, int *pNumChanged, uint32 offset, uint32 size)
+{
+	uint32 start = offset + FLASH_BASE_ADDRESS, end = start + size, blockEnd;
+	int i;
+
+	if(size == 0)
+		return 0;
+
+	for(i = 0; i < *pNumChanged; i++)
+	{
+		blockEnd = pChanged[i].Address + pChanged[i].ByteCount;
+		if(start <= blockEnd && end >= pChanged[i].Address)
+		{
+			start = MIN(start, pChanged[i].Address);
+			end = MAX(end, blockEnd);
+			pChanged[i] = pChanged[--(*pNumChanged)];
+			i = -1;		/* the larger range may now touch ranges already checked */
+		}
+	}
+
+	if(*pNumChanged >= FRMW_MAX_CHANGED_BLOCKS)
+		return ERROR_WRONG_PARAMS;
+	pChanged[*pNumChanged].Address = start;
+	pChanged[*pNumChanged].ByteCount = end - start;
+	(*pNumChanged)++;
 	return 0;
 }
 
+/* Writes data to the image and records the range from the first to the last byte that changed */
+static int SPLASH_PatchImage(unsigned char *pImage, uint32 offset, const void *pData, uint32 size,
+				FLASH_BLOCK *pChanged, int *pNumChanged)
+{
+	const unsigned char *p = (const unsigned char *)pData;
+	uint32 first, last;
+
+	for(first = 0; first < size && pImage[offset + first] == p[first]; first++)
+		;
+	if(first == size)
+		return 0;
+	for(last = size - 1; pImage[offset + last] == p[last]; last--)
+		;
+
+	memcpy(pImage + offset + first, p + first, last - first + 1);
+	return SPLASH_AddChanged(pChanged, pNumChanged, offset + first, last - first + 1);
+}
+
+int Frmw_SPLASH_ReplaceSplash(unsigned char **ppImage, uint32 *pSize, int index, unsigned char *pImageBuffer,
+				uint8 *compression, uint32 *compSize, FLASH_BLOCK *pChanged, int *pNumChanged)
+/**
+ * Replaces one splash image of a firmware image that has already been built, without rebuilding
+ * the other images. The new blob is written over the old one if it fits before the next blob
+ * and the old data isn't shared with another image; otherwise it goes to the free space after
+ * the splash data, growing the image, and the blob table entry and the Splash_Data flash table
+ * entry are updated. An image identical to another one of the firmware shares its data.
+ *
+ * The changed ranges are reported as flash addresses, FLASH_BASE_ADDRESS plus the offset in the
+ * image, from the first to the last byte that differs. Frmw_BlocksToSectors turns them into the
+ * sectors to program.
+ *
+ * @param   ppImage - I/O - firmware image allocated with malloc, reallocated when it grows
+ * @param   pSize - I/O - size of the image in bytes
+ * @param   index - I - splash image to be replaced
+ * @param   pImageBuffer - I - BMP file
+ * @param   compression - I/O - compression, see Frmw_SPLASH_AddSplash
+ * @param   compSize - O - size of the compressed image
+ * @param   pChanged - O - changed ranges, FRMW_MAX_CHANGED_BLOCKS entries
+ * @param   pNumChanged - O - number of changed ranges
+ *
+ * @return  0 = PASS <BR>
+ *          ERROR_NO_FLASH_SPACE = the new image doesn't fit, the firmware image is unchanged <BR>
+ *          otherwise ERROR_xxx <BR>
+ *
+ */
+{
+	FRMW_VIEW view;
+	SPLASH_IMAGE image;
+	SPLASH_REGION regions[3];
+	SPLASH_BLOB_INFO blob_info;
+	unsigned char *pImage;
+	uint32 blobsOffset, tableOffset, splashStart, slotStart, slotEnd, dataEnd, offset, target, blobSize, newSize, value;
+	int i, r, numRegions, source = -1, ret;
+	BOOL oldValid, shared = FALSE;
+
+	*pNumChanged = 0;
+
+	ret = Frmw_ViewInit(&view, *ppImage, *pSize);
+	if(ret < 0)
+		return ret;
+	if(view.pSplashInfo == NULL || index < 0 || index >= view.SplashCount)
+		return ERROR_WRONG_PARAMS;
+
+	blobsOffset = (const unsigned char *)view.pBlobs - *ppImage;
+	tableOffset = view.FlashTableAddress;
+	splashStart = view.pFlashTable->Splash_Data[FLASH_TABLE_SPLASH_INDEX].Address;
+
+	ret = SPLASH_PrepareImage(pImageBuffer, *compression, &image);
+	if(ret < 0)
+		return ret;
+	blobSize = sizeof(SPLASH_HEADER) + image.Size;
+
+	/* The old blob may grow up to the next blob or the end of its chip select. Blobs at the same
+	 * offset share their data. */
+	slotStart = slotEnd = 0;
+	oldValid = Frmw_ViewGetSplashHeader(&view, index, NULL, NULL) != NULL;
+	if(oldValid)
+	{
+		Frmw_ViewFlashToOffset(&view, view.pBlobs[index].BlobOffset, view.pBlobs[index].BlobSize, &slotStart);
+		numRegions = SPLASH_GetRegions(slotStart + FLASH_BASE_ADDRESS, regions);
+		if(numRegions > 0 && regions[0].Start == slotStart + FLASH_BASE_ADDRESS)
+			slotEnd = regions[0].End - FLASH_BASE_ADDRESS;
+	}
+	dataEnd = blobsOffset + view.SplashCount * sizeof(SPLASH_BLOB_INFO);
+
+	for(i = 0; i < view.SplashCount; i++)
+	{
+		if(Frmw_ViewGetSplashHeader(&view, i, NULL, NULL) == NULL)
+			continue;
+		Frmw_ViewFlashToOffset(&view, view.pBlobs[i].BlobOffset, view.pBlobs[i].BlobSize, &offset);
+		dataEnd = MAX(dataEnd, offset + view.pBlobs[i].BlobSize);
+
+		if(source < 0 && view.pBlobs[i].BlobSize == blobSize &&
+			memcmp(*ppImage + offset, &image.Header, sizeof(SPLASH_HEADER)) == 0 &&
+			memcmp(*ppImage + offset + sizeof(SPLASH_HEADER), image.pData, image.Size) == 0)
+			source = i;
+
+		if(i == index || !oldValid)
+			continue;
+		if(offset == slotStart)
+			shared = TRUE;
+		else if(offset > slotStart)
+			slotEnd = MIN(slotEnd, offset);
+	}
+
+	if(source >= 0)
+		blob_info = view.pBlobs[source];
+	else
+	{
+		if(oldValid && !shared && slotStart + blobSize <= slotEnd)
+		{
+			target = slotStart;
+		}
+		else
+		{
+			/* First chip select with room after the splash data */
+			numRegions = SPLASH_GetRegions(dataEnd + FLASH_BASE_ADDRESS, regions);
+			for(r = 0; r < numRegions && regions[r].End - regions[r].Start < blobSize; r++)
+				;
+			if(r == numRegions)
+			{
+				printf("NO SPACE LEFT IN THE FLASH CAN'T WRITE SPLASH [%d]\n", index);
+				SPLASH_FreeImage(&image);
+				return ERROR_NO_FLASH_SPACE;
+			}
+			target = regions[r].Start - FLASH_BASE_ADDRESS;
+		}
+
+		newSize = MAX(*pSize, target + blobSize);
+		if(newSize > *pSize)
+		{
+			pImage = (unsigned char *)realloc(*ppImage, newSize);
+			if(pImage == NULL)
+			{
+				SPLASH_FreeImage(&image);
+				return ERROR_NO_MEM_FOR_MALLOC;
+			}
+			memset(pImage + *pSize, 0xFF, newSize - *pSize);
+			SPLASH_AddChanged(pChanged, pNumChanged, *pSize, newSize - *pSize);
+			*ppImage = pImage;
+			*pSize = newSize;
+		}
+
+		/* Bytes of a smaller blob's old slot are left as they are, nothing refers to them */
+		SPLASH_PatchImage(*ppImage, target, &image.Header, sizeof(SPLASH_HEADER), pChanged, pNumChanged);
+		SPLASH_PatchImage(*ppImage, target + sizeof(SPLASH_HEADER), image.pData, image.Size, pChanged, pNumChanged);
+
+		blob_info.BlobOffset = target + FLASH_BASE_ADDRESS;
+		blob_info.BlobSize = blobSize;
+		if(blob_info.BlobOffset >= FLASH_THREE_ADDRESS)
+			blob_info.BlobOffset -= 0x03000000;
+
+		/* Splash data that grew past the end recorded in the flash table */
+		if(target + blobSize > dataEnd)
+		{
+			offset = tableOffset + offsetof(FLASH_TABLE, Splash_Data) + FLASH_TABLE_SPLASH_INDEX * sizeof(FLASH_BLOCK) +
+					offsetof(FLASH_BLOCK, ByteCount);
+			memcpy(&value, *ppImage + offset, sizeof(value));
+			if(value != 0 && value < target + blobSize + FLASH_BASE_ADDRESS - splashStart)
+			{
+				value = target + blobSize + FLASH_BASE_ADDRESS - splashStart;
+				SPLASH_PatchImage(*ppImage, offset, &value, sizeof(value), pChanged, pNumChanged);
+			}
+
+			offset = tableOffset + offsetof(FLASH_TABLE, Free_Area_Start);
+			memcpy(&value, *ppImage + offset, sizeof(value));
+			if(value >= splashStart && value < target + blobSize + FLASH_BASE_ADDRESS)
+			{
+				value = target + blobSize + FLASH_BASE_ADDRESS;
+				SPLASH_PatchImage(*ppImage, offset, &value, sizeof(value), pChanged, pNumChanged);
+			}
+		}
+	}
+
+	ret = SPLASH_PatchImage(*ppImage, blobsOffset + index * sizeof(SPLASH_BLOB_INFO), &blob_info, sizeof(blob_info),
+				pChanged, pNumChanged);
+
+	*compression = image.Compression;
+	*compSize = image.Size;
+	SPLASH_FreeImage(&image);
+	return ret;
+}
+
+int Frmw_BlocksToSectors(const FLASH_BLOCK *pBlocks, int numBlocks, const uint32 *pSectorAddr, uint32 numSectors,
+				unsigned char *pChanged)
+/**
+ * Marks the flash sectors touched by ranges reported by Frmw_SPLASH_ReplaceSplash.
+ *
+ * @param   pBlocks - I - ranges, at FLASH_BASE_ADDRESS plus the offset in the image
+ * @param   numBlocks - I - number of ranges
+ * @param   pSectorAddr - I - offset of every sector followed by the end of the last one, as in FLASH_DEVICE
+ * @param   numSectors - I - number of sectors
+ * @param   pChanged - O - one byte per sector, 1 = touched
+ *
+ * @return  number of sectors touched
+ *
+ */
+{
+	uint32 start, end, s;
+	int i, count = 0;
+
+	memset(pChanged, 0, numSectors);
+	for(i = 0; i < numBlocks; i++)
+	{
+		start = pBlocks[i].Address - FLASH_BASE_ADDRESS;
+		end = start + pBlocks[i].ByteCount;
+		for(s = 0; s < numSectors; s++)
+		{
+			if(!pChanged[s] && pSectorAddr[s] < end && pSectorAddr[s + 1] > start)
+			{
+				pChanged[s] = 1;
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
 void Frmw_Get_NewFlashImage(unsigned char **newFrmwbuffer, uint32 *newFrmwsize)
 {
 	uint32 newfrmFileInLen = (splash_data_start_flash_address - FLASH_BASE_ADDRESS) + splash_index;
@@ -748,3 +2270,210 @@ void Frmw_UpdateFlashTableSplashAddress(unsigned char *flashTableSectorBuffer, u
 
 	free(temp_flashTableSector);
 }
+
+/* Tokens of DLPC350 INI files in iniTokens order, with the most values each takes. Their place in
+ * the application configuration data (frmw_offset, frmw_size) isn't filled in, so INI files are
+ * parsed but not applied to firmware images. */
+#define INI_PARAM(token, count)	{ token, { 0 }, { 0 }, count, 0, false, 0, 0 }
+
+static const INIPARAM_INFO IniParams[NR_INI_TOKENS] =
+{
+	INI_PARAM("APPCONFIG.VERSION.SUBMINOR",		  1),
+	INI_PARAM("DEFAULT.AUTOSTART",			  1),
+	INI_PARAM("DEFAULT.DISPMODE",			  1),
+	INI_PARAM("DEFAULT.SHORT_FLIP",			  1),
+	INI_PARAM("DEFAULT.LONG_FLIP",			  1),
+	INI_PARAM("DEFAULT.TRIG_OUT_1.POL",		  1),
+	INI_PARAM("DEFAULT.TRIG_OUT_1.RDELAY",		  1),
+	INI_PARAM("DEFAULT.TRIG_OUT_1.FDELAY",		  1),
+	INI_PARAM("DEFAULT.TRIG_OUT_2.POL",		  1),
+	INI_PARAM("DEFAULT.TRIG_OUT_2.WIDTH",		  1),
+	INI_PARAM("DEFAULT.TRIG_IN_1.DELAY",		  1),
+	INI_PARAM("DEFAULT.TRIG_IN_2.POL",		  1),
+	INI_PARAM("DEFAULT.RED_STROBE.RDELAY",		  1),
+	INI_PARAM("DEFAULT.RED_STROBE.FDELAY",		  1),
+	INI_PARAM("DEFAULT.GRN_STROBE.RDELAY",		  1),
+	INI_PARAM("DEFAULT.GRN_STROBE.FDELAY",		  1),
+	INI_PARAM("DEFAULT.BLU_STROBE.RDELAY",		  1),
+	INI_PARAM("DEFAULT.BLU_STROBE.FDELAY",		  1),
+	INI_PARAM("DEFAULT.INVERTDATA",			  1),
+	INI_PARAM("DEFAULT.LEDCURRENT_RED",		  1),
+	INI_PARAM("DEFAULT.LEDCURRENT_GRN",		  1),
+	INI_PARAM("DEFAULT.LEDCURRENT_BLU",		  1),
+	INI_PARAM("DEFAULT.PATTERNCONFIG.PAT_EXPOSURE",	  1),
+	INI_PARAM("DEFAULT.PATTERNCONFIG.PAT_PERIOD",	  1),
+	INI_PARAM("DEFAULT.PATTERNCONFIG.PAT_MODE",	  1),
+	INI_PARAM("DEFAULT.PATTERNCONFIG.TRIG_MODE",	  1),
+	INI_PARAM("DEFAULT.PATTERNCONFIG.PAT_REPEAT",	  1),
+	INI_PARAM("DEFAULT.PATTERNCONFIG.NUM_LUT_ENTRIES",	  1),
+	INI_PARAM("DEFAULT.PATTERNCONFIG.NUM_PATTERNS",	  1),
+	INI_PARAM("DEFAULT.PATTERNCONFIG.NUM_SPLASH",	  1),
+	INI_PARAM("DEFAULT.SPLASHLUT",			 64),
+	INI_PARAM("DEFAULT.SEQPATLUT",			128),
+	INI_PARAM("DEFAULT.PORTCONFIG.PORT",		  1),
+	INI_PARAM("DEFAULT.PORTCONFIG.BPP",		  1),
+	INI_PARAM("DEFAULT.PORTCONFIG.PIX_FMT",		  1),
+	INI_PARAM("DEFAULT.PORTCONFIG.PORT_CLK",	  1),
+	INI_PARAM("DEFAULT.PORTCONFIG.ABC_MUX",		  1),
+	INI_PARAM("DEFAULT.PORTCONFIG.PIX_MODE",	  1),
+	INI_PARAM("DEFAULT.PORTCONFIG.SWAP_POL",	  1),
+	INI_PARAM("DEFAULT.PORTCONFIG.FLD_SEL",		  1),
+	INI_PARAM("PERIPHERALS.I2CADDRESS[0]",		  1),
+	INI_PARAM("PERIPHERALS.I2CADDRESS[1]",		  1),
+	INI_PARAM("DATAPATH.SPLASHSTARTUPTIMEOUT",	  1),
+	INI_PARAM("DATAPATH.SPLASHATSTARTUPENABLE",	  1),
+};
+
+/* Line most recently parsed by Frmw_ParseIniLines */
+static char ini_token[FRMW_INI_TOKEN_LEN];
+static uint32 ini_params[FRMW_INI_MAX_PARAMS];
+static int ini_num_params;
+static BOOL ini_in_comment;
+
+static int INI_FindField(const char *pToken, uint32 length)
+{
+	const char *p;
+	uint32 i;
+	int field;
+
+	/* Most tokens share their beginning, so compare from the end */
+	for(field = 0; field < NR_INI_TOKENS; field++)
+	{
+		p = IniParams[field].token;
+		if(strlen(p) != length)
+			continue;
+		for(i = length; i > 0 && toupper((unsigned char)pToken[i - 1]) == p[i - 1]; i--)
+			;
+		if(i == 0)
+			return field;
+	}
+	return -1;
+}
+
+/* Parses one INI line, "TOKEN value value ... ;", ignoring comments (// and # to the end of the
+ * line, block comments across lines; *pInComment carries a block comment to the next line).
+ * Returns 0 with the token and values, 1 if the line holds no token, ERROR_WRONG_PARAMS if it
+ * doesn't parse. Nothing is allocated. */
+static int INI_ParseLine(const char *p, const char *pEnd, BOOL *pInComment, const char **ppToken,
+			uint32 *pTokenLength, uint32 *pParams, int *pNumParams)
+{
+	const char *pToken = NULL;
+	unsigned long long value;
+	int numParams = 0, digit, base;
+	BOOL done = FALSE;
+
+	while(p < pEnd && !done)
+	{
+		if(*pInComment)
+		{
+			for(; p + 1 < pEnd && !(p[0] == '*' && p[1] == '/'); p++)
+				;
+			if(p + 1 >= pEnd)
+				break;
+			p += 2;
+			*pInComment = FALSE;
+		}
+		else if(*p == ' ' || *p == '\t' || *p == '\r' || *p == ',' || *p == '=')
+		{
+			p++;
+		}
+		else if(*p == '#' || (*p == '/' && p + 1 < pEnd && p[1] == '/'))
+		{
+			break;
+		}
+		else if(*p == '/' && p + 1 < pEnd && p[1] == '*')
+		{
+			p += 2;
+			*pInComment = TRUE;
+		}
+		else if(*p == ';')
+		{
+			done = TRUE;
+		}
+		else if(pToken == NULL)
+		{
+			for(pToken = p; p < pEnd && *p > ' ' && *p != ';' && *p != '=' && *p != ','; p++)
+				;
+			*pTokenLength = p - pToken;
+		}
+		else
+		{
+			base = 10;
+			if(p + 1 < pEnd && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+			{
+				base = 16;
+				p += 2;
+			}
+			for(value = 0, digit = 0; p < pEnd && isxdigit((unsigned char)*p); p++, digit++)
+			{
+				if(!isdigit((unsigned char)*p) && base == 10)
+					return ERROR_WRONG_PARAMS;
+				value = value * base + (isdigit((unsigned char)*p) ? *p - '0' : toupper((unsigned char)*p) - 'A' + 10);
+				if(value > 0xFFFFFFFF)
+					return ERROR_WRONG_PARAMS;
+			}
+			if(digit == 0 || numParams >= FRMW_INI_MAX_PARAMS ||
+				(p < pEnd && *p > ' ' && *p != ';' && *p != ',' && *p != '/' && *p != '#'))
+				return ERROR_WRONG_PARAMS;
+			pParams[numParams++] = (uint32)value;
+		}
+	}
+
+	if(pToken == NULL)
+		return 1;
+	if(numParams == 0)
+		return ERROR_WRONG_PARAMS;
+
+	*ppToken = pToken;
+	*pNumParams = numParams;
+	return 0;
+}
+
+int Frmw_ParseIniLines(const char *iniLine)
+/**
+ * Parses one line of a DLPC350 INI file, "TOKEN value value ... ;". The token and values are
+ * read back with Frmw_GetCurrentIniLineParam.
+ *
+ * @param   iniLine - I - line, without or with its end of line
+ *
+ * @return  0 = token parsed <BR>
+ *          1 = the line only holds a comment or white space <BR>
+ *          ERROR_WRONG_PARAMS = unknown token or malformed values <BR>
+ *
+ */
+{
+	const char *pToken;
+	uint32 length;
+	int field, ret;
+
+	ret = INI_ParseLine(iniLine, iniLine + strlen(iniLine), &ini_in_comment, &pToken, &length, ini_params, &ini_num_params);
+	if(ret != 0)
+	{
+		ini_num_params = 0;
+		return ret;
+	}
+
+	field = INI_FindField(pToken, length);
+	if(field < 0 || ini_num_params > IniParams[field].nr_default_params)
+	{
+		ini_num_params = 0;
+		return ERROR_WRONG_PARAMS;
+	}
+	strcpy(ini_token, IniParams[field].token);
+	return 0;
+}
+
+void Frmw_GetCurrentIniLineParam(char *token, uint32 *params, int *numParams)
+/**
+ * Returns the line parsed by the last successful call of Frmw_ParseIniLines.
+ *
+ * @param   token - O - token, FRMW_INI_TOKEN_LEN characters
+ * @param   params - O - values, FRMW_INI_MAX_PARAMS entries
+ * @param   numParams - O - number of values
+ *
+ */
+{
+	strcpy(token, ini_token);
+	memcpy(params, ini_params, ini_num_params * sizeof(uint32));
+	*numParams = ini_num_params;
+}
@@ -12,11 +12,12 @@
 #define FIRMWARE_H
 
 #include "Common.h"
-#include <QString>
+#include "filemap.h"
 
 #define RELEASE_FW_VERSION  0x10100 // update for new DLPC350 binaries
 
 #define MAX_SPLASH_IMAGES		128
+#define FRMW_MAX_CHANGED_BLOCKS		8
 #define FLASH_TABLE_SPLASH_INDEX	0
 #define FLASHTABLE_APP_SIGNATURE	0x01234567
 
@@ -40,6 +41,9 @@
 #define ERROR_NOT_24bit_BMP_FILE		-5
 #define ERROR_INIT_NOT_DONE_PROPERLY		-6
 #define ERROR_WRONG_PARAMS			-7
+#define ERROR_WRITE_FAILED			-8
+#define ERROR_NO_FLASH_SPACE			-9
+#define ERROR_READ_FAILED			-10
 
 #define SPLASH_UNCOMPRESSED		0
 #define SPLASH_RLE_COMPRESSION		1
@@ -48,6 +52,8 @@
 
 #define NR_INI_TOKENS			44
 #define NR_INI_GUI_TOKENS		34
+#define FRMW_INI_TOKEN_LEN		64
+#define FRMW_INI_MAX_PARAMS		128
 
 typedef struct
 {
@@ -120,9 +126,66 @@ typedef struct splashhdr
     uint8  Pad[4];         /**< pad so that data starts at 16-byte boundary */
 } SPLASH_HEADER;
 
+/** Read-only view of a firmware image in memory or mapped from a file */
+typedef struct
+{
+    FILEMAP Map;                                    /* mapping when opened from a file */
+    const unsigned char *pImage;
+    uint32 Size;
+    uint32 FlashTableAddress;                       /* offset of the flash table in the image */
+    const FLASH_TABLE *pFlashTable;
+    const SPLASH_SUPER_BINARY_INFO *pSplashInfo;    /* NULL if there is no splash blob table */
+    const SPLASH_BLOB_INFO *pBlobs;
+    int SplashCount;
+} FRMW_VIEW;
+
+/** Location and format of one splash image, see Frmw_SplashIndexBuild */
+typedef struct
+{
+    uint32 Offset;          /* offset of the image data in the firmware image */
+    uint32 Size;            /* size of the image data in bytes */
+    uint16 Width;
+    uint16 Height;
+    uint8 Compression;
+    BOOL Valid;             /* FALSE if the slot is empty or its blob is invalid */
+} SPLASH_INDEX_ENTRY;
+
+typedef struct
+{
+    const FRMW_VIEW *pView;
+    int Count;
+    SPLASH_INDEX_ENTRY *pEntries;
+} SPLASH_INDEX;
+
+/** Splash space of one chip select, see Frmw_SPLASH_GetUsage */
+typedef struct
+{
+    uint32 Capacity;        /* bytes available for splash blobs */
+    uint32 Used;            /* bytes taken by splash blobs */
+    uint32 Padding;         /* bytes skipped in front of or between the blobs */
+    uint32 Shared;          /* bytes saved by blobs sharing the data of an identical blob */
+    uint32 NumBlobs;
+} SPLASH_CS_USAGE;
+
+/** Load times measured for one compression, see Frmw_SPLASH_ModelAddSample */
+typedef struct
+{
+    uint32 NumSamples;
+    double SumSize;         /* image data sizes in bytes */
+    double SumTime;         /* load times in microseconds */
+    double SumSizeSq;
+    double SumSizeTime;
+} SPLASH_LOAD_SAMPLES;
+
+/** Load time of a splash image as a linear function of its data size, one per compression */
+typedef struct
+{
+    SPLASH_LOAD_SAMPLES Samples[SPLASH_NOCOMP_SPECIFIED];  /* indexed by compression */
+} SPLASH_LOAD_MODEL;
+
 typedef struct iniParamInfo
 {
-	QString token;
+	char token[FRMW_INI_TOKEN_LEN];
 	uint32 default_param[128];
 	uint32 gui_defined_param[128];
 	int nr_default_params;
@@ -194,10 +257,41 @@ uint32 Frmw_GetSPlashFlashStartAddress();
 int Frmw_GetSpashImage(unsigned char *pImageBuffer, int index);
 int Frmw_SPLASH_InitBuffer(int numSplash);
 int Frmw_SPLASH_AddSplash(unsigned char *pImageBuffer, uint8 *compression, uint32 *compSize);
+int Frmw_SPLASH_AddSplashBatch(unsigned char **ppImageBuffers, int numImages, uint8 *pCompression, uint32 *pCompSize, int numThreads);
+int Frmw_SPLASH_AddSplashPacked(unsigned char **ppImageBuffers, int numImages, uint8 *pCompression, uint32 *pCompSize, int numThreads);
+int Frmw_SPLASH_GetUsage(SPLASH_CS_USAGE *pUsage);
+int Frmw_SPLASH_SetCacheDir(const char *path);
+void Frmw_SPLASH_GetCacheStats(uint32 *pHits, uint32 *pMisses);
+uint32 Frmw_SPLASH_GetBytesShared(void);
+void Frmw_SPLASH_ModelInit(SPLASH_LOAD_MODEL *pModel);
+int Frmw_SPLASH_ModelAddSample(SPLASH_LOAD_MODEL *pModel, uint8 compression, uint32 size, uint32 loadTime);
+int Frmw_SPLASH_ModelAddTimings(SPLASH_LOAD_MODEL *pModel, const SPLASH_INDEX *pIndex, const uint32 *pLoadTimes, int numImages);
+int Frmw_SPLASH_ModelPredict(const SPLASH_LOAD_MODEL *pModel, uint8 compression, uint32 size, uint32 *pLoadTime);
+int Frmw_SPLASH_SetLoadPolicy(const SPLASH_LOAD_MODEL *pModel, uint32 targetTime);
+int Frmw_SPLASH_GetLoadTime(int index, uint32 *pLoadTime);
+int Frmw_SPLASH_ReplaceSplash(unsigned char **ppImage, uint32 *pSize, int index, unsigned char *pImageBuffer,
+				uint8 *compression, uint32 *compSize, FLASH_BLOCK *pChanged, int *pNumChanged);
+int Frmw_BlocksToSectors(const FLASH_BLOCK *pBlocks, int numBlocks, const uint32 *pSectorAddr, uint32 numSectors,
+				unsigned char *pChanged);
+int Frmw_SPLASH_InitStream(int fd, int numSplash);
+int Frmw_SPLASH_FinishStream(uint32 *pImageSize);
+int Frmw_FindFlashTable(const unsigned char *pImage, uint32 size, uint32 *pAddress);
+int Frmw_ViewInit(FRMW_VIEW *pView, const unsigned char *pImage, uint32 size);
+int Frmw_ViewOpen(FRMW_VIEW *pView, const char *path);
+void Frmw_ViewClose(FRMW_VIEW *pView);
+int Frmw_ViewFlashToOffset(const FRMW_VIEW *pView, uint32 address, uint32 size, uint32 *pOffset);
+const SPLASH_BLOB_INFO *Frmw_ViewGetBlob(const FRMW_VIEW *pView, int index);
+const SPLASH_HEADER *Frmw_ViewGetSplashHeader(const FRMW_VIEW *pView, int index, const unsigned char **ppData, uint32 *pDataSize);
+int Frmw_SplashIndexBuild(SPLASH_INDEX *pIndex, const FRMW_VIEW *pView);
+void Frmw_SplashIndexFree(SPLASH_INDEX *pIndex);
+const SPLASH_INDEX_ENTRY *Frmw_SplashIndexGet(const SPLASH_INDEX *pIndex, int index);
+int Frmw_SplashIndexDecode(const SPLASH_INDEX *pIndex, int index, unsigned char *pImageBuffer, uint32 bufferSize);
+const unsigned char *Frmw_SplashIndexView(const SPLASH_INDEX *pIndex, int index, uint32 *pLineLength);
+int Frmw_SplashIndexExport(const SPLASH_INDEX *pIndex, const char *pathFormat, int numThreads, int *pNumWritten,
+				uint32 *pImagesPerSecond);
 void Frmw_Get_NewFlashImage(unsigned char **newFrmwbuffer, uint32 *newFrmwsize);
 void Frmw_Get_NewSplashBuffer(unsigned char **newSplashBuffer, uint32 *newSplashSize);
 void Frmw_UpdateFlashTableSplashAddress(unsigned char *flashTableSectorBuffer, uint32 address_offset);
-int Frmw_ParseIniLines(QString iniLine);
-void Frmw_GetCurrentIniLineParam(QString *token, uint32 *params, int *numParams);
-int Frmw_WriteApplConfigData(QString token, uint32 *params, int numParams);
+int Frmw_ParseIniLines(const char *iniLine);
+void Frmw_GetCurrentIniLineParam(char *token, uint32 *params, int *numParams);
 #endif
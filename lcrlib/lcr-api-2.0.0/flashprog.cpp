@@ -0,0 +1,933 @@
+/*
+ * flashprog.cpp
+ *
+ * This module reprograms the flash sector by sector, erasing and writing only the sectors whose
+ * content differs from the new firmware image.
+ *
+ * The sector layout of the flash device comes from the flash device parameters file shipped with
+ * the GUI (Flash/FlashDeviceParameters.txt). Changed sectors are found either by comparing the new
+ * image against the image that was last programmed or, when that image is not available, against
+ * the checksum the controller computes for every sector. All functions except
+ * LCR_FlashReadDeviceParams() work only in programming mode.
+ *
+ * Programming runs as a pipeline: a producer thread encodes the download messages into a ring of
+ * USB reports while the caller's thread erases sectors and writes the reports.
+ * LCR_FlashProgramUnits() runs one such pipeline per controller, each on its own thread talking to
+ * its own device, see USB_Select().
+ *
+*/
+
+#include "flashprog.h"
+#include "checksum.h"
+#include "filemap.h"
+#include "scheduler.h"
+#include "threadpool.h"
+#include "usb.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLPROG_PIPE_DEPTH       64      /* download messages encoded ahead of the transfer */
+#define FLPROG_POLL_TIME        200     /* microseconds between checks of the pipe */
+#define FLPROG_READY_TIMEOUT    10000   /* milliseconds an erase, program or checksum may keep the flash busy */
+
+typedef struct
+{
+    uint32  Start;
+    uint32  Size;
+    uint32  FirstSector;
+    uint32  NumSectors;
+} FLPROG_SEGMENT;
+
+/* Single producer, single consumer ring of encoded download messages */
+typedef struct
+{
+    const uint8 *pImage;
+    const FLPROG_SEGMENT *pSegments;
+    uint32 NumSegments;
+    uint32 Segment;         /* producer position */
+    uint32 Offset;
+    volatile long Produced;
+    volatile long Consumed;
+    volatile long Abort;
+    unsigned int NumReports[FLPROG_PIPE_DEPTH];
+    unsigned int Bytes[FLPROG_PIPE_DEPTH];
+    unsigned char Reports[FLPROG_PIPE_DEPTH][HID_MESSAGE_MAX_REPORTS * (USB_MAX_PACKET_SIZE + 1)];
+} FLPROG_PIPE;
+
+/* The controllers programmed by LCR_FlashProgramUnits() */
+typedef struct
+{
+    const char *ParamsPath;
+    FLPROG_UNIT *pUnits;
+    const unsigned char *pImage;
+    unsigned int ImageSize;
+    unsigned int Flags;
+    FLPROG_UNIT_PROGRESS Progress;
+    void *pParam;
+} FLPROG_UNITS;
+
+typedef struct
+{
+    FLPROG_UNITS *pUnits;
+    unsigned int Unit;
+    THREAD_HANDLE Thread;
+    bool Started;
+} FLPROG_UNIT_TASK;
+
+/* Copies the next comma separated field of a line without the surrounding blanks and quotes */
+static const char *FLPROG_NextField(const char *p, const char *pEnd, char *field, unsigned int fieldSize)
+{
+    const char *pStart, *pStop;
+    unsigned int len;
+
+    while(p < pEnd && (*p == ' ' || *p == '\t'))
+        p++;
+    pStart = p;
+    while(p < pEnd && *p != ',' && *p != '\r' && *p != '\n' && *p != '/')
+        p++;
+    pStop = p;
+    while(pStop > pStart && (pStop[-1] == ' ' || pStop[-1] == '\t'))
+        pStop--;
+    if(pStop - pStart >= 2 && *pStart == '"' && pStop[-1] == '"')
+    {
+        pStart++;
+        pStop--;
+    }
+
+    len = MIN((unsigned int)(pStop - pStart), fieldSize - 1);
+    memcpy(field, pStart, len);
+    field[len] = 0;
+
+    if(p < pEnd && *p == ',')
+        p++;
+    return p;
+}
+
+static int FLPROG_ParseLine(const char *p, const char *pEnd, FLASH_DEVICE *pDevice)
+{
+    char field[64];
+    unsigned long value;
+    char *pNumEnd;
+    unsigned int i, numSectors = 0, numFields = 0;
+
+    memset(pDevice, 0, sizeof(FLASH_DEVICE));
+    while(p < pEnd && *p != '\r' && *p != '\n' && *p != '/')
+    {
+        p = FLPROG_NextField(p, pEnd, field, sizeof(field));
+        if(field[0] == 0)
+            continue;
+
+        if(numFields == 0 || numFields == 2)
+        {
+            if(numFields == 2)
+                snprintf(pDevice->Name, sizeof(pDevice->Name), "%s", field);
+            numFields++;
+            continue;
+        }
+
+        value = strtoul(field, &pNumEnd, 0);
+        if(*pNumEnd != 0)
+            return -1;
+
+        switch(numFields)
+        {
+        case 1: pDevice->MfgID = (uint16)value; break;
+        case 3: pDevice->DevID = (uint16)value; break;
+        case 4: break;  /* size in Mbit, redundant with the size in bytes */
+        case 5: pDevice->Type = (uint8)value; break;
+        case 6: pDevice->Size = (uint32)value; break;
+        case 7:
+            numSectors = (unsigned int)value;
+            if(numSectors > FLPROG_MAX_SECTORS)
+                return -1;
+            break;
+        default:
+            /* The list is padded with zeros beyond the number of sectors */
+            if(pDevice->NumSectors < numSectors)
+                pDevice->SectorAddr[pDevice->NumSectors++] = (uint32)value;
+            break;
+        }
+        numFields++;
+    }
+
+    /* Some lists end with the device size */
+    if(pDevice->NumSectors > 1 && pDevice->SectorAddr[pDevice->NumSectors - 1] == pDevice->Size)
+        pDevice->NumSectors--;
+    if(pDevice->NumSectors == 0 || pDevice->Size == 0)
+        return -1;
+
+    /* Erasing a sector only clears the sector the address belongs to, so a wrong layout would
+     * leave stale data under new content. Accept strictly increasing lists only. */
+    for(i = 1; i < pDevice->NumSectors; i++)
+    {
+        if(pDevice->SectorAddr[i] <= pDevice->SectorAddr[i - 1])
+            return -1;
+    }
+    if(pDevice->SectorAddr[pDevice->NumSectors - 1] >= pDevice->Size)
+        return -1;
+
+    /* The last sector is never larger than the one before it */
+    i = pDevice->NumSectors;
+    pDevice->SectorAddr[i] = pDevice->Size;
+    if(i > 1 && pDevice->SectorAddr[i] - pDevice->SectorAddr[i - 1] > pDevice->SectorAddr[i - 1] - pDevice->SectorAddr[i - 2])
+        pDevice->SectorAddr[i] = pDevice->SectorAddr[i - 1] + (pDevice->SectorAddr[i - 1] - pDevice->SectorAddr[i - 2]);
+
+    return 0;
+}
+
+/* Waits for the flash busy flag to go off like LCR_WaitForFlashReady(), but fails if the status
+ * can't be read, e.g. the controller was disconnected, or the flag stays on for FLPROG_READY_TIMEOUT */
+static int FLPROG_WaitReady(void)
+{
+    unsigned long long deadline = LCR_SchedNow() + FLPROG_READY_TIMEOUT * 1000000ULL;
+    unsigned char status;
+
+    for(;;)
+    {
+        if(LCR_GetBLStatus(&status) < 0)
+            return -1;
+        if((status & STAT_BIT_FLASH_BUSY) == 0)
+            return 0;
+        if(LCR_SchedNow() >= deadline)
+            return -1;
+    }
+}
+
+static int FLPROG_DeviceChecksum(uint32 address, uint32 size, uint32 *pChecksum)
+{
+    if(LCR_SetFlashAddr(address) < 0 || LCR_SetDownloadSize(size) < 0)
+        return -1;
+    if(LCR_CalculateFlashChecksum() < 0 || FLPROG_WaitReady() < 0)
+        return -1;
+
+    return LCR_GetFlashChecksum((unsigned int *)pChecksum) < 0 ? -1 : 0;
+}
+
+extern "C" int LCR_FlashReadDeviceParams(const char *paramsPath, unsigned short manID, unsigned short devID, FLASH_DEVICE *pDevice)
+/**
+ * Looks up the flash device in the flash device parameters file.
+ * The device is identified by both the manufacturer and device ID as devices of different
+ * manufacturers share device IDs.
+ *
+ * @param   paramsPath - I - path of the flash device parameters file
+ * @param   manID - I - manufacturer ID, see LCR_GetFlashManID()
+ * @param   devID - I - device ID, see LCR_GetFlashDevID()
+ * @param   pDevice - O - device size, programming type and sector layout
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL, file not readable, device not listed or sector list invalid <BR>
+ *
+ */
+{
+    FILEMAP map;
+    const char *p, *pEnd;
+    int ret = -1;
+
+    if(pDevice == NULL || FILEMAP_Open(&map, paramsPath) < 0)
+        return -1;
+
+    p = (const char *)map.Data;
+    pEnd = p + map.Size;
+    while(p < pEnd)
+    {
+        while(p < pEnd && (*p == ' ' || *p == '\t'))
+            p++;
+        if(p < pEnd && *p == '"' && FLPROG_ParseLine(p, pEnd, pDevice) == 0 &&
+           pDevice->MfgID == manID && pDevice->DevID == devID)
+        {
+            ret = 0;
+            break;
+        }
+        while(p < pEnd && *p != '\n')
+            p++;
+        p++;
+    }
+
+    FILEMAP_Close(&map);
+    return ret;
+}
+
+extern "C" int LCR_FlashDetectDevice(const char *paramsPath, FLASH_DEVICE *pDevice)
+/**
+ * This function works only in programming mode.
+ * Reads the flash IDs from the controller and looks the device up in the flash device parameters file.
+ *
+ * @param   paramsPath - I - path of the flash device parameters file
+ * @param   pDevice - O - device size, programming type and sector layout
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL <BR>
+ *
+ */
+{
+    unsigned short manID;
+    unsigned long long devID;
+
+    if(LCR_GetFlashManID(&manID) < 0 || LCR_GetFlashDevID(&devID) < 0)
+        return -1;
+
+    return LCR_FlashReadDeviceParams(paramsPath, manID, (unsigned short)(devID & 0xFFFF), pDevice);
+}
+
+/* Marks the sectors to program, skipping the ones below startAddress */
+static int FLPROG_Diff(const FLASH_DEVICE *pDevice, const uint8 *pNew, uint32 newSize, const uint8 *pOld, uint32 oldSize, unsigned int flags, uint32 startAddress, unsigned char *pChanged)
+{
+    uint32 i, start, end, sum;
+    int numChanged = 0;
+
+    if(pDevice == NULL || pNew == NULL || pChanged == NULL || newSize > pDevice->SectorAddr[pDevice->NumSectors])
+        return -1;
+
+    for(i = 0; i < pDevice->NumSectors; i++)
+    {
+        start = pDevice->SectorAddr[i];
+        end = MIN(pDevice->SectorAddr[i + 1], newSize);
+        pChanged[i] = 0;
+
+        if(start >= newSize || start < startAddress || ((flags & FLPROG_SKIP_BOOTLOADER) && start < FLPROG_BOOTLOADER_SIZE))
+            continue;
+
+        if(flags & FLPROG_ALL_SECTORS)
+            pChanged[i] = 1;
+        else if(pOld != NULL)
+        {
+            if(end > oldSize || memcmp(pNew + start, pOld + start, end - start) != 0)
+                pChanged[i] = 1;
+        }
+        else
+        {
+            if(FLPROG_DeviceChecksum(start, end - start, &sum) < 0)
+                return -1;
+            if(sum != CHKSUM_ByteSum(pNew + start, end - start))
+                pChanged[i] = 1;
+        }
+        numChanged += pChanged[i];
+    }
+
+    return numChanged;
+}
+
+/* Groups runs of changed sectors into segments of at most FLPROG_SEGMENT_SIZE bytes */
+static uint32 FLPROG_PlanSegments(const FLASH_DEVICE *pDevice, const unsigned char *pChanged, uint32 imageSize, FLPROG_SEGMENT *pSegments)
+{
+    uint32 i, end, numSegments = 0;
+    FLPROG_SEGMENT *pSeg = NULL;
+
+    for(i = 0; i < pDevice->NumSectors; i++)
+    {
+        if(!pChanged[i])
+        {
+            pSeg = NULL;
+            continue;
+        }
+
+        end = MIN(pDevice->SectorAddr[i + 1], imageSize);
+        if(pSeg == NULL || end - pSeg->Start > FLPROG_SEGMENT_SIZE)
+        {
+            pSeg = &pSegments[numSegments++];
+            pSeg->Start = pDevice->SectorAddr[i];
+            pSeg->FirstSector = i;
+            pSeg->NumSectors = 0;
+        }
+        pSeg->Size = end - pSeg->Start;
+        pSeg->NumSectors++;
+    }
+
+    return numSegments;
+}
+
+/* Encodes the next download message into the pipe.
+ * Returns 1 = encoded, 0 = pipe full, -1 = every segment encoded */
+static int FLPROG_EncodeNext(FLPROG_PIPE *pPipe)
+{
+    const FLPROG_SEGMENT *pSeg;
+    unsigned int slot;
+    long produced = pPipe->Produced;
+
+    if(pPipe->Segment >= pPipe->NumSegments)
+        return -1;
+    if(produced - THREAD_AtomicLoad(&pPipe->Consumed) >= FLPROG_PIPE_DEPTH)
+        return 0;
+
+    pSeg = &pPipe->pSegments[pPipe->Segment];
+    slot = produced % FLPROG_PIPE_DEPTH;
+    pPipe->Bytes[slot] = LCR_EncodeDownloadData(pPipe->pImage + pSeg->Start + pPipe->Offset, pSeg->Size - pPipe->Offset,
+                                                pPipe->Reports[slot], &pPipe->NumReports[slot]);
+    pPipe->Offset += pPipe->Bytes[slot];
+    if(pPipe->Offset >= pSeg->Size)
+    {
+        pPipe->Segment++;
+        pPipe->Offset = 0;
+    }
+
+    THREAD_AtomicIncrement(&pPipe->Produced);
+    return 1;
+}
+
+static void FLPROG_Producer(void *pContext, unsigned int index)
+{
+    FLPROG_PIPE *pPipe = (FLPROG_PIPE *)pContext;
+    int ret;
+
+    (void)index;
+    while(!THREAD_AtomicLoad(&pPipe->Abort))
+    {
+        ret = FLPROG_EncodeNext(pPipe);
+        if(ret < 0)
+            break;
+        if(ret == 0)
+            THREAD_Sleep(FLPROG_POLL_TIME);
+    }
+}
+
+/* Sends the next encoded message. Without a producer thread the message is encoded here. */
+static int FLPROG_SendNext(FLPROG_PIPE *pPipe, bool threaded, uint32 *pBytes)
+{
+    unsigned int slot;
+
+    while(THREAD_AtomicLoad(&pPipe->Produced) == pPipe->Consumed)
+    {
+        if(!threaded)
+            FLPROG_EncodeNext(pPipe);
+        else
+            THREAD_Sleep(FLPROG_POLL_TIME);
+    }
+
+    slot = pPipe->Consumed % FLPROG_PIPE_DEPTH;
+    *pBytes = pPipe->Bytes[slot];
+    if(LCR_SendReports(pPipe->Reports[slot], pPipe->NumReports[slot]) < 0)
+        return -1;
+
+    THREAD_AtomicIncrement(&pPipe->Consumed);
+    return 0;
+}
+
+static int FLPROG_ReadCheckpoint(const char *path, FLPROG_CHECKPOINT *pCheckpoint)
+{
+    FILE *fp;
+    int ret = -1;
+
+    fp = fopen(path, "rb");
+    if(fp == NULL)
+        return -1;
+
+    if(fread(pCheckpoint, sizeof(FLPROG_CHECKPOINT), 1, fp) == 1 &&
+       pCheckpoint->Signature == FLPROG_CHECKPOINT_SIGNATURE && pCheckpoint->Version == FLPROG_CHECKPOINT_VERSION &&
+       CHKSUM_Crc32((const uint8 *)pCheckpoint, offsetof(FLPROG_CHECKPOINT, Checksum)) == pCheckpoint->Checksum)
+        ret = 0;
+
+    fclose(fp);
+    return ret;
+}
+
+static int FLPROG_WriteCheckpoint(const char *path, FLPROG_CHECKPOINT *pCheckpoint)
+{
+    char tempPath[1024];
+    FILE *fp;
+
+    pCheckpoint->Checksum = CHKSUM_Crc32((const uint8 *)pCheckpoint, offsetof(FLPROG_CHECKPOINT, Checksum));
+
+    if(snprintf(tempPath, sizeof(tempPath), "%s.tmp", path) >= (int)sizeof(tempPath))
+        return -1;
+
+    fp = fopen(tempPath, "wb");
+    if(fp == NULL)
+        return -1;
+
+    if(fwrite(pCheckpoint, sizeof(FLPROG_CHECKPOINT), 1, fp) != 1)
+    {
+        fclose(fp);
+        remove(tempPath);
+        return -1;
+    }
+
+    if(fclose(fp) != 0)
+    {
+        remove(tempPath);
+        return -1;
+    }
+
+#ifdef _WIN32
+    remove(path);
+#endif
+    if(rename(tempPath, path) != 0)
+    {
+        remove(tempPath);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void FLPROG_Report(FLPROG_STATUS *pStatus, unsigned long long startTime, uint32 startBytes, FLPROG_PROGRESS progress, void *pParam)
+{
+    unsigned long long elapsed = LCR_SchedNow() - startTime;
+    unsigned long long rate;
+
+    if(progress == NULL)
+        return;
+
+    rate = elapsed > 0 ? (unsigned long long)(pStatus->BytesDone - startBytes) * 1000000000ULL / elapsed : 0;
+    pStatus->BytesPerSecond = (unsigned int)rate;
+    pStatus->EtaMs = rate > 0 ? (unsigned int)((unsigned long long)(pStatus->BytesTotal - pStatus->BytesDone) * 1000 / rate) : 0;
+    progress(pStatus, pParam);
+}
+
+/* Erases, programs and verifies the segments in order */
+static int FLPROG_Run(const FLASH_DEVICE *pDevice, FLPROG_PIPE *pPipe, bool threaded, FLPROG_CHECKPOINT *pCheckpoint,
+                      const char *checkpointPath, FLPROG_STATUS *pStatus, FLPROG_PROGRESS progress, void *pParam)
+{
+    const FLPROG_SEGMENT *pSeg;
+    unsigned long long startTime, lastReport;
+    uint32 i, j, sent, bytes, sum, startBytes = pStatus->BytesDone;
+
+    startTime = lastReport = LCR_SchedNow();
+    FLPROG_Report(pStatus, startTime, startBytes, progress, pParam);
+
+    for(i = 0; i < pPipe->NumSegments; i++)
+    {
+        pSeg = &pPipe->pSegments[i];
+
+        /* The next messages are being encoded while the sectors are erased */
+        for(j = pSeg->FirstSector; j < pSeg->FirstSector + pSeg->NumSectors; j++)
+        {
+            if(LCR_SetFlashAddr(pDevice->SectorAddr[j]) < 0 || LCR_FlashSectorErase() < 0 || FLPROG_WaitReady() < 0)
+                return -1;
+        }
+
+        if(LCR_SetFlashAddr(pSeg->Start) < 0 || LCR_SetDownloadSize(pSeg->Size) < 0)
+            return -1;
+
+        for(sent = 0; sent < pSeg->Size; sent += bytes)
+        {
+            if(FLPROG_SendNext(pPipe, threaded, &bytes) < 0)
+                return -1;
+
+            pStatus->BytesDone += bytes;
+            if(LCR_SchedNow() - lastReport >= FLPROG_PROGRESS_INTERVAL * 1000000ULL)
+            {
+                lastReport = LCR_SchedNow();
+                FLPROG_Report(pStatus, startTime, startBytes, progress, pParam);
+            }
+        }
+        if(FLPROG_WaitReady() < 0)
+            return -1;
+
+        if(FLPROG_DeviceChecksum(pSeg->Start, pSeg->Size, &sum) < 0)
+            return -1;
+        if(sum != CHKSUM_ByteSum(pPipe->pImage + pSeg->Start, pSeg->Size))
+            return FLPROG_VERIFY_FAILED;
+
+        pStatus->SectorsDone += pSeg->NumSectors;
+        if(checkpointPath != NULL)
+        {
+            pCheckpoint->NextAddress = pSeg->Start + pSeg->Size;
+            if(FLPROG_WriteCheckpoint(checkpointPath, pCheckpoint) < 0)
+                return -1;
+        }
+
+        lastReport = LCR_SchedNow();
+        FLPROG_Report(pStatus, startTime, startBytes, progress, pParam);
+    }
+
+    return 0;
+}
+
+extern "C" int LCR_FlashImageChecksum(const unsigned char *pImage, unsigned int imageSize, unsigned int address, unsigned int length, unsigned int *pChecksum)
+/**
+ * Computes on the host the checksum LCR_GetFlashChecksum() returns for a flash range holding the
+ * given firmware image, which starts at flash address 0.
+ *
+ * @param   pImage - I - firmware image
+ * @param   imageSize - I - size of the image in bytes
+ * @param   address - I - flash address of the range, as passed to LCR_SetFlashAddr()
+ * @param   length - I - size of the range, as passed to LCR_SetDownloadSize()
+ * @param   pChecksum - O - checksum of the range
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL, range outside of the image <BR>
+ *
+ */
+{
+    if(pImage == NULL || pChecksum == NULL || address > imageSize || length > imageSize - address)
+        return -1;
+
+    *pChecksum = CHKSUM_ByteSum(pImage + address, length);
+    return 0;
+}
+
+extern "C" int LCR_FlashFileChecksum(const char *imagePath, unsigned int address, unsigned int length, unsigned int *pChecksum)
+/**
+ * Computes on the host the checksum LCR_GetFlashChecksum() returns for a flash range holding the
+ * given firmware image file, see LCR_FlashImageChecksum().
+ *
+ * @param   imagePath - I - firmware image file
+ * @param   address - I - flash address of the range
+ * @param   length - I - size of the range
+ * @param   pChecksum - O - checksum of the range
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL <BR>
+ *
+ */
+{
+    FILEMAP map;
+    int ret;
+
+    if(FILEMAP_Open(&map, imagePath) < 0)
+        return -1;
+
+    ret = LCR_FlashImageChecksum(map.Data, map.Size, address, length, pChecksum);
+
+    FILEMAP_Close(&map);
+    return ret;
+}
+
+extern "C" int LCR_FlashDiffSectors(const FLASH_DEVICE *pDevice, const unsigned char *pNew, unsigned int newSize, const unsigned char *pOld, unsigned int oldSize, bool skipBootloader, unsigned char *pChanged)
+/**
+ * Finds the sectors that have to be reprogrammed to turn the flash content into the new image.
+ * The new image starts at flash address 0. Only the sectors holding part of the new image are
+ * compared; the others are never marked.
+ *
+ * Without the old image the flash content is compared through the byte sum checksum the
+ * controller computes for every sector, which needs programming mode. The byte sum does not
+ * detect reordered bytes, so pass the old image when it is known.
+ *
+ * @param   pDevice - I - flash device, see LCR_FlashDetectDevice()
+ * @param   pNew - I - new firmware image
+ * @param   newSize - I - size of the new image in bytes
+ * @param   pOld - I - image currently in flash, NULL = compare against the device checksums
+ * @param   oldSize - I - size of the old image in bytes
+ * @param   skipBootloader - I - leave the sectors of the bootloader untouched
+ * @param   pChanged - O - one flag per sector of the device, 1 = sector to reprogram
+ *
+ * @return  number of changed sectors <BR>
+ *          -1 = FAIL, image larger than the device or checksum not read <BR>
+ *
+ */
+{
+    return FLPROG_Diff(pDevice, pNew, newSize, pOld, oldSize, skipBootloader ? FLPROG_SKIP_BOOTLOADER : 0, 0, pChanged);
+}
+
+extern "C" int LCR_FlashProgram(const FLASH_DEVICE *pDevice, const unsigned char *pNew, unsigned int newSize, const unsigned char *pOld, unsigned int oldSize, unsigned int flags, const char *checkpointPath, FLPROG_PROGRESS progress, void *pParam, unsigned int *pNumProgrammed)
+/**
+ * This function works only in programming mode.
+ * Erases, programs and verifies the sectors that differ between the new image and the flash
+ * content, see LCR_FlashDiffSectors(), or every sector of the image with FLPROG_ALL_SECTORS.
+ *
+ * Adjacent sectors are programmed in segments of up to FLPROG_SEGMENT_SIZE bytes: the sectors of
+ * a segment are erased, its data is downloaded in one stream and verified with the controller
+ * checksum. A background thread encodes the download messages ahead of the transfer, so the USB
+ * reports go out back to back while the erases and transfers are running.
+ *
+ * With a checkpoint file the end of the last verified segment is recorded together with the
+ * image checksum. A run interrupted by a failure or a disconnect, which fails the call as soon as
+ * the controller stops answering, continues from there when called again with the same image and
+ * file. The file is removed when the whole image is programmed.
+ *
+ * @param   pDevice - I - flash device, see LCR_FlashDetectDevice()
+ * @param   pNew - I - new firmware image
+ * @param   newSize - I - size of the new image in bytes
+ * @param   pOld - I - image currently in flash, NULL = compare against the device checksums
+ * @param   oldSize - I - size of the old image in bytes
+ * @param   flags - I - FLPROG_SKIP_BOOTLOADER, FLPROG_ALL_SECTORS
+ * @param   checkpointPath - I - checkpoint file, NULL = no checkpoint
+ * @param   progress - I - called with the progress, throughput and remaining time, may be NULL
+ * @param   pParam - I - passed to progress
+ * @param   pNumProgrammed - O - number of sectors reprogrammed, may be NULL
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL <BR>
+ *          FLPROG_VERIFY_FAILED = the checksum of a programmed segment doesn't match <BR>
+ *
+ */
+{
+    FLPROG_CHECKPOINT checkpoint, saved;
+    FLPROG_STATUS status;
+    FLPROG_PIPE *pPipe;
+    FLPROG_SEGMENT *pSegments;
+    THREAD_HANDLE producer;
+    unsigned char *pChanged;
+    bool threaded;
+    uint32 i, resumeAddress = 0;
+    int ret;
+
+    if(pNumProgrammed != NULL)
+        *pNumProgrammed = 0;
+    if(pDevice == NULL || pNew == NULL || newSize > pDevice->SectorAddr[pDevice->NumSectors])
+        return -1;
+
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    checkpoint.Signature = FLPROG_CHECKPOINT_SIGNATURE;
+    checkpoint.Version = FLPROG_CHECKPOINT_VERSION;
+    checkpoint.MfgID = pDevice->MfgID;
+    checkpoint.DevID = pDevice->DevID;
+    checkpoint.ImageSize = newSize;
+    if(checkpointPath != NULL)
+    {
+        checkpoint.ImageCrc = CHKSUM_Crc32(pNew, newSize);
+        if(FLPROG_ReadCheckpoint(checkpointPath, &saved) == 0 && saved.MfgID == checkpoint.MfgID &&
+           saved.DevID == checkpoint.DevID && saved.ImageSize == newSize && saved.ImageCrc == checkpoint.ImageCrc)
+            resumeAddress = saved.NextAddress;
+    }
+
+    pChanged = (unsigned char *)malloc(pDevice->NumSectors);
+    pSegments = (FLPROG_SEGMENT *)malloc(pDevice->NumSectors * sizeof(FLPROG_SEGMENT));
+    pPipe = (FLPROG_PIPE *)malloc(sizeof(FLPROG_PIPE));
+    if(pChanged == NULL || pSegments == NULL || pPipe == NULL)
+    {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if(LCR_SetFlashType(pDevice->Type) < 0 ||
+       FLPROG_Diff(pDevice, pNew, newSize, pOld, oldSize, flags, resumeAddress, pChanged) < 0)
+    {
+        ret = -1;
+        goto cleanup;
+    }
+
+    memset(pPipe, 0, sizeof(FLPROG_PIPE));
+    pPipe->pImage = pNew;
+    pPipe->pSegments = pSegments;
+    pPipe->NumSegments = FLPROG_PlanSegments(pDevice, pChanged, newSize, pSegments);
+
+    /* Bytes already verified in an interrupted run count as done */
+    memset(&status, 0, sizeof(status));
+    status.BytesDone = status.BytesTotal = MIN(resumeAddress, newSize);
+    for(i = 0; i < pPipe->NumSegments; i++)
+    {
+        status.BytesTotal += pSegments[i].Size;
+        status.SectorsTotal += pSegments[i].NumSectors;
+    }
+
+    threaded = THREAD_Start(&producer, FLPROG_Producer, pPipe) == 0;
+    ret = FLPROG_Run(pDevice, pPipe, threaded, &checkpoint, checkpointPath, &status, progress, pParam);
+    if(threaded)
+    {
+        THREAD_AtomicIncrement(&pPipe->Abort);
+        THREAD_Join(producer);
+    }
+
+    if(pNumProgrammed != NULL)
+        *pNumProgrammed = status.SectorsDone;
+    if(ret == 0 && checkpointPath != NULL)
+        remove(checkpointPath);
+
+cleanup:
+    free(pChanged);
+    free(pSegments);
+    free(pPipe);
+    return ret;
+}
+
+extern "C" int LCR_FlashProgramDiff(const FLASH_DEVICE *pDevice, const unsigned char *pNew, unsigned int newSize, const unsigned char *pOld, unsigned int oldSize, bool skipBootloader, unsigned int *pNumProgrammed)
+/**
+ * This function works only in programming mode.
+ * Erases, programs and verifies the sectors that differ between the new image and the flash
+ * content, see LCR_FlashProgram().
+ *
+ * @param   pDevice - I - flash device, see LCR_FlashDetectDevice()
+ * @param   pNew - I - new firmware image
+ * @param   newSize - I - size of the new image in bytes
+ * @param   pOld - I - image currently in flash, NULL = compare against the device checksums
+ * @param   oldSize - I - size of the old image in bytes
+ * @param   skipBootloader - I - leave the sectors of the bootloader untouched
+ * @param   pNumProgrammed - O - number of sectors reprogrammed, may be NULL
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL <BR>
+ *          FLPROG_VERIFY_FAILED = the checksum of a programmed segment doesn't match <BR>
+ *
+ */
+{
+    return LCR_FlashProgram(pDevice, pNew, newSize, pOld, oldSize, skipBootloader ? FLPROG_SKIP_BOOTLOADER : 0,
+                            NULL, NULL, NULL, pNumProgrammed);
+}
+
+extern "C" int LCR_FlashProgramFile(const char *paramsPath, const char *newPath, const char *oldPath, unsigned int flags, const char *checkpointPath, FLPROG_PROGRESS progress, void *pParam, unsigned int *pNumProgrammed)
+/**
+ * This function works only in programming mode.
+ * Detects the flash device and programs the new firmware file, see LCR_FlashProgram().
+ *
+ * @param   paramsPath - I - path of the flash device parameters file
+ * @param   newPath - I - new firmware image file
+ * @param   oldPath - I - firmware image file currently in flash, NULL = compare against the device checksums
+ * @param   flags - I - FLPROG_SKIP_BOOTLOADER, FLPROG_ALL_SECTORS
+ * @param   checkpointPath - I - checkpoint file, NULL = no checkpoint
+ * @param   progress - I - called with the progress, throughput and remaining time, may be NULL
+ * @param   pParam - I - passed to progress
+ * @param   pNumProgrammed - O - number of sectors reprogrammed, may be NULL
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL <BR>
+ *          FLPROG_VERIFY_FAILED = the checksum of a programmed segment doesn't match <BR>
+ *
+ */
+{
+    FLASH_DEVICE device;
+    FILEMAP newMap, oldMap;
+    int ret;
+
+    if(LCR_FlashDetectDevice(paramsPath, &device) < 0)
+        return -1;
+
+    if(FILEMAP_Open(&newMap, newPath) < 0)
+        return -1;
+
+    oldMap.Data = NULL;
+    oldMap.Size = 0;
+    if(oldPath != NULL && FILEMAP_Open(&oldMap, oldPath) < 0)
+    {
+        FILEMAP_Close(&newMap);
+        return -1;
+    }
+
+    ret = LCR_FlashProgram(&device, newMap.Data, newMap.Size, oldMap.Data, oldMap.Size, flags, checkpointPath, progress, pParam, pNumProgrammed);
+
+    if(oldPath != NULL)
+        FILEMAP_Close(&oldMap);
+    FILEMAP_Close(&newMap);
+    return ret;
+}
+
+extern "C" int LCR_FlashProgramFileDiff(const char *paramsPath, const char *newPath, const char *oldPath, bool skipBootloader, unsigned int *pNumProgrammed)
+/**
+ * This function works only in programming mode.
+ * Detects the flash device and reprograms the sectors that differ between the new firmware file
+ * and the flash content, see LCR_FlashProgram().
+ *
+ * @param   paramsPath - I - path of the flash device parameters file
+ * @param   newPath - I - new firmware image file
+ * @param   oldPath - I - firmware image file currently in flash, NULL = compare against the device checksums
+ * @param   skipBootloader - I - leave the sectors of the bootloader untouched
+ * @param   pNumProgrammed - O - number of sectors reprogrammed, may be NULL
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL <BR>
+ *          FLPROG_VERIFY_FAILED = the checksum of a programmed segment doesn't match <BR>
+ *
+ */
+{
+    return LCR_FlashProgramFile(paramsPath, newPath, oldPath, skipBootloader ? FLPROG_SKIP_BOOTLOADER : 0,
+                                NULL, NULL, NULL, pNumProgrammed);
+}
+
+static void FLPROG_UnitProgress(const FLPROG_STATUS *pStatus, void *pParam)
+{
+    FLPROG_UNIT_TASK *pTask = (FLPROG_UNIT_TASK *)pParam;
+    FLPROG_UNITS *pUnits = pTask->pUnits;
+
+    pUnits->pUnits[pTask->Unit].Status = *pStatus;
+    if(pUnits->Progress != NULL)
+        pUnits->Progress(pTask->Unit, pStatus, pUnits->pParam);
+}
+
+/* Programs one unit on the calling thread. A failure only ends the programming of this unit. */
+static void FLPROG_UnitTask(void *pContext, unsigned int index)
+{
+    FLPROG_UNIT_TASK *pTask = (FLPROG_UNIT_TASK *)pContext;
+    FLPROG_UNITS *pUnits = pTask->pUnits;
+    FLPROG_UNIT *pUnit = &pUnits->pUnits[pTask->Unit];
+    FLASH_DEVICE device;
+    USB_DEVICE usb;
+
+    (void)index;
+    pUnit->Result = -1;
+    pUnit->NumProgrammed = 0;
+    memset(&pUnit->Status, 0, sizeof(pUnit->Status));
+
+    if(USB_OpenPath(pUnit->Path, &usb) < 0)
+        return;
+    USB_Select(&usb);
+
+    if(LCR_FlashDetectDevice(pUnits->ParamsPath, &device) == 0)
+    {
+        if(pUnit->pImage != NULL)
+            pUnit->Result = LCR_FlashProgram(&device, pUnit->pImage, pUnit->ImageSize, pUnit->pOld, pUnit->OldSize, pUnits->Flags,
+                                             pUnit->CheckpointPath, FLPROG_UnitProgress, pTask, &pUnit->NumProgrammed);
+        else
+            pUnit->Result = LCR_FlashProgram(&device, pUnits->pImage, pUnits->ImageSize, pUnit->pOld, pUnit->OldSize, pUnits->Flags,
+                                             pUnit->CheckpointPath, FLPROG_UnitProgress, pTask, &pUnit->NumProgrammed);
+    }
+
+    USB_Select(NULL);
+    USB_CloseDevice(&usb);
+}
+
+extern "C" int LCR_FlashProgramUnits(const char *paramsPath, FLPROG_UNIT *pUnits, unsigned int numUnits, const unsigned char *pImage, unsigned int imageSize, unsigned int flags, FLPROG_UNIT_PROGRESS progress, void *pParam)
+/**
+ * Programs several controllers at the same time, see LCR_FlashProgram(). Every controller must be
+ * in programming mode. Each unit is opened by its device path and programmed by its own thread,
+ * so the total time is about the time of the slowest unit. The images are only read, units
+ * sharing an image share its buffer.
+ *
+ * A unit that fails, e.g. because it was disconnected or a segment didn't verify, doesn't stop
+ * the others; its Result tells why. A unit whose flash stays busy fails after FLPROG_READY_TIMEOUT. With a checkpoint file per unit the failed units continue
+ * where they stopped when programmed again.
+ *
+ * @param   paramsPath - I - path of the flash device parameters file, the device of every unit is detected
+ * @param   pUnits - I/O - controllers to program and their results
+ * @param   numUnits - I - number of units
+ * @param   pImage - I - image of the units without their own image, may be NULL if every unit has one
+ * @param   imageSize - I - size of the shared image in bytes
+ * @param   flags - I - FLPROG_SKIP_BOOTLOADER, FLPROG_ALL_SECTORS
+ * @param   progress - I - called with the index of the unit and its progress, may be NULL.
+ *                         It is called from the threads of the units, at the same time for different units.
+ * @param   pParam - I - passed to progress
+ *
+ * @return  number of units that failed, 0 = PASS <BR>
+ *          -1 = FAIL, a unit has no path or no image <BR>
+ *
+ */
+{
+    FLPROG_UNITS units;
+    FLPROG_UNIT_TASK *pTasks;
+    unsigned int i;
+    int numFailed = 0;
+
+    if(pUnits == NULL)
+        return -1;
+    for(i = 0; i < numUnits; i++)
+    {
+        if(pUnits[i].Path == NULL || (pUnits[i].pImage == NULL && pImage == NULL))
+            return -1;
+    }
+
+    pTasks = (FLPROG_UNIT_TASK *)malloc(numUnits * sizeof(FLPROG_UNIT_TASK));
+    if(pTasks == NULL && numUnits > 0)
+        return -1;
+
+    units.ParamsPath = paramsPath;
+    units.pUnits = pUnits;
+    units.pImage = pImage;
+    units.ImageSize = imageSize;
+    units.Flags = flags;
+    units.Progress = progress;
+    units.pParam = pParam;
+
+    /* A unit whose thread doesn't start is programmed here once the others are running */
+    for(i = 0; i < numUnits; i++)
+    {
+        pTasks[i].pUnits = &units;
+        pTasks[i].Unit = i;
+        pTasks[i].Started = THREAD_Start(&pTasks[i].Thread, FLPROG_UnitTask, &pTasks[i]) == 0;
+    }
+    for(i = 0; i < numUnits; i++)
+    {
+        if(!pTasks[i].Started)
+            FLPROG_UnitTask(&pTasks[i], 0);
+    }
+    for(i = 0; i < numUnits; i++)
+    {
+        if(pTasks[i].Started)
+            THREAD_Join(pTasks[i].Thread);
+        if(pUnits[i].Result != 0)
+            numFailed++;
+    }
+
+    free(pTasks);
+    return numFailed;
+}
@@ -0,0 +1,93 @@
+/*
+ * flashprog.h
+ *
+ * This module reprograms the flash sector by sector, erasing and writing only the sectors whose
+ * content differs from the new firmware image.
+ *
+*/
+
+#ifndef FLASHPROG_H
+#define FLASHPROG_H
+
+#include "Common.h"
+#include "API.h"
+
+#define FLPROG_MAX_SECTORS      1024
+#define FLPROG_BOOTLOADER_SIZE  0x20000     /* flash reserved for the bootloader */
+
+#define FLPROG_SEGMENT_SIZE     0x20000     /* most bytes erased, programmed and verified as one unit */
+#define FLPROG_PROGRESS_INTERVAL 250        /* milliseconds between progress reports during a segment */
+
+#define FLPROG_VERIFY_FAILED    -2
+
+/* LCR_FlashProgram() flags */
+#define FLPROG_SKIP_BOOTLOADER  0x1         /* leave the bootloader sectors untouched */
+#define FLPROG_ALL_SECTORS      0x2         /* program every sector of the image without comparing */
+
+#define FLPROG_CHECKPOINT_SIGNATURE 0x504B4346  /* "FCKP" */
+#define FLPROG_CHECKPOINT_VERSION   1
+
+typedef struct
+{
+    char    Name[64];
+    uint16  MfgID;
+    uint16  DevID;
+    uint8   Type;           /* programming algorithm, see LCR_SetFlashType() */
+    uint32  Size;           /* device size in bytes */
+    uint32  NumSectors;
+    uint32  SectorAddr[FLPROG_MAX_SECTORS + 1];    /* start of every sector followed by the end of the last one */
+} FLASH_DEVICE;
+
+typedef struct
+{
+    uint32  Signature;      /* FLPROG_CHECKPOINT_SIGNATURE */
+    uint16  Version;        /* FLPROG_CHECKPOINT_VERSION */
+    uint16  Reserved;
+    uint16  MfgID;
+    uint16  DevID;
+    uint32  ImageSize;
+    uint32  ImageCrc;       /* CRC-32 of the image being programmed */
+    uint32  NextAddress;    /* everything below is programmed and verified */
+    uint32  Checksum;       /* CRC-32 of the fields above */
+} FLPROG_CHECKPOINT;
+
+typedef struct
+{
+    unsigned int BytesDone;         /* including the bytes verified by an interrupted run */
+    unsigned int BytesTotal;
+    unsigned int SectorsDone;       /* sectors programmed and verified by this run */
+    unsigned int SectorsTotal;
+    unsigned int BytesPerSecond;    /* measured over this run */
+    unsigned int EtaMs;             /* estimated time to completion */
+} FLPROG_STATUS;
+
+typedef void (*FLPROG_PROGRESS)(const FLPROG_STATUS *pStatus, void *pParam);
+
+/* One controller programmed by LCR_FlashProgramUnits() */
+typedef struct
+{
+    const char *Path;               /* device path, see USB_Enumerate() */
+    const unsigned char *pImage;    /* image of this unit, NULL = the image shared by all units */
+    unsigned int ImageSize;
+    const unsigned char *pOld;      /* image in the flash of this unit, NULL = compare against the device checksums */
+    unsigned int OldSize;
+    const char *CheckpointPath;     /* NULL = no checkpoint */
+    int Result;                     /* O - result of LCR_FlashProgram(), -1 if the device didn't open */
+    unsigned int NumProgrammed;     /* O - sectors reprogrammed */
+    FLPROG_STATUS Status;           /* O - last progress reported */
+} FLPROG_UNIT;
+
+typedef void (*FLPROG_UNIT_PROGRESS)(unsigned int unit, const FLPROG_STATUS *pStatus, void *pParam);
+
+extern "C" int API_API_EXPORT LCR_FlashReadDeviceParams(const char *paramsPath, unsigned short manID, unsigned short devID, FLASH_DEVICE *pDevice);
+extern "C" int API_API_EXPORT LCR_FlashDetectDevice(const char *paramsPath, FLASH_DEVICE *pDevice);
+extern "C" int API_API_EXPORT LCR_FlashImageChecksum(const unsigned char *pImage, unsigned int imageSize, unsigned int address, unsigned int length, unsigned int *pChecksum);
+extern "C" int API_API_EXPORT LCR_FlashFileChecksum(const char *imagePath, unsigned int address, unsigned int length, unsigned int *pChecksum);
+extern "C" int API_API_EXPORT LCR_FlashDiffSectors(const FLASH_DEVICE *pDevice, const unsigned char *pNew, unsigned int newSize, const unsigned char *pOld, unsigned int oldSize, bool skipBootloader, unsigned char *pChanged);
+extern "C" int API_API_EXPORT LCR_FlashProgram(const FLASH_DEVICE *pDevice, const unsigned char *pNew, unsigned int newSize, const unsigned char *pOld, unsigned int oldSize, unsigned int flags, const char *checkpointPath, FLPROG_PROGRESS progress, void *pParam, unsigned int *pNumProgrammed);
+extern "C" int API_API_EXPORT LCR_FlashProgramDiff(const FLASH_DEVICE *pDevice, const unsigned char *pNew, unsigned int newSize, const unsigned char *pOld, unsigned int oldSize, bool skipBootloader, unsigned int *pNumProgrammed);
+extern "C" int API_API_EXPORT LCR_FlashProgramFile(const char *paramsPath, const char *newPath, const char *oldPath, unsigned int flags, const char *checkpointPath, FLPROG_PROGRESS progress, void *pParam, unsigned int *pNumProgrammed);
+extern "C" int API_API_EXPORT LCR_FlashProgramUnits(const char *paramsPath, FLPROG_UNIT *pUnits, unsigned int numUnits, const unsigned char *pImage, unsigned int imageSize, unsigned int flags, FLPROG_UNIT_PROGRESS progress, void *pParam);
+extern "C" int API_API_EXPORT LCR_FlashProgramFileDiff(const char *paramsPath, const char *newPath, const char *oldPath, bool skipBootloader, unsigned int *pNumProgrammed);
+
+#endif // FLASHPROG_H
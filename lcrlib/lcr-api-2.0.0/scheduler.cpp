@@ -0,0 +1,319 @@
+/*
+ * scheduler.cpp
+ *
+ * This module issues pattern start/stop/pause and splash load commands at absolute host times.
+ *
+ * Commands are encoded into USB reports when they are scheduled, so running the schedule only writes
+ * prepared reports. Each deadline is approached with a timer sleep (timerfd on Linux) that wakes
+ * SCHED_SPIN_TIME early, followed by a busy-wait on the monotonic clock for the final microseconds.
+ * The time every report is issued and written is recorded, and the write latencies are accumulated
+ * in a log2 histogram.
+ *
+*/
+
+#include "scheduler.h"
+#include "usb.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef __linux__
+#include <sys/timerfd.h>
+#include <errno.h>
+#endif
+
+typedef struct
+{
+    unsigned long long Deadline;
+    unsigned char Report[USB_MAX_PACKET_SIZE+1];
+    long long Issued;       /* nanoseconds after the deadline the write was started */
+    long long Written;      /* nanoseconds after the deadline the write returned */
+    int Result;
+} SCHED_EVENT;
+
+static SCHED_EVENT Events[SCHED_MAX_EVENTS];
+static unsigned int NumEvents;
+static SCHED_STATS Stats;
+static long long LatencySum;
+
+extern "C" unsigned long long LCR_SchedNow(void)
+/**
+ * @return  current host time in nanoseconds on the clock used for deadlines (CLOCK_MONOTONIC on Linux)
+ *
+ */
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (unsigned long long)(count.QuadPart / freq.QuadPart) * 1000000000ULL +
+           (unsigned long long)(count.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static int SCHED_HistBin(long long latency)
+{
+    long long us = latency / 1000;
+    int bin = 0;
+
+    while(us > 0 && bin < SCHED_HIST_BINS - 1)
+    {
+        us >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+static void SCHED_Record(SCHED_EVENT *pEvent)
+{
+    if(pEvent->Result < 0)
+    {
+        Stats.NumFailed++;
+        return;
+    }
+
+    if(Stats.NumEvents == 0 || pEvent->Written < Stats.MinLatency)
+        Stats.MinLatency = pEvent->Written;
+    if(Stats.NumEvents == 0 || pEvent->Written > Stats.MaxLatency)
+        Stats.MaxLatency = pEvent->Written;
+
+    Stats.NumEvents++;
+    LatencySum += pEvent->Written;
+    Stats.MeanLatency = LatencySum / Stats.NumEvents;
+    Stats.Histogram[SCHED_HistBin(pEvent->Written)]++;
+}
+
+#ifdef _WIN32
+static int SCHED_SleepUntil(int timer, unsigned long long wakeTime)
+{
+    unsigned long long now;
+
+    (void)timer;
+    for(now = LCR_SchedNow(); now + 2000000ULL < wakeTime; now = LCR_SchedNow())
+        Sleep((DWORD)((wakeTime - now) / 1000000ULL) - 1);
+    return 0;
+}
+#elif defined(__linux__)
+static int SCHED_SleepUntil(int timer, unsigned long long wakeTime)
+{
+    struct itimerspec its;
+    unsigned long long expirations;
+    ssize_t n;
+
+    if(wakeTime <= LCR_SchedNow())
+        return 0;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = wakeTime / 1000000000ULL;
+    its.it_value.tv_nsec = wakeTime % 1000000000ULL;
+    if(timerfd_settime(timer, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        return -1;
+
+    /* A signal only interrupts the wait, the timer is still armed */
+    while((n = read(timer, &expirations, sizeof(expirations))) < 0 && errno == EINTR)
+        ;
+    return n == sizeof(expirations) ? 0 : -1;
+}
+#else
+static int SCHED_SleepUntil(int timer, unsigned long long wakeTime)
+{
+    struct timespec ts;
+    unsigned long long now;
+
+    (void)timer;
+    for(now = LCR_SchedNow(); now < wakeTime; now = LCR_SchedNow())
+    {
+        ts.tv_sec = (wakeTime - now) / 1000000000ULL;
+        ts.tv_nsec = (wakeTime - now) % 1000000000ULL;
+        nanosleep(&ts, NULL);
+    }
+    return 0;
+}
+#endif
+
+extern "C" void LCR_SchedClear(void)
+/**
+ * Removes all scheduled events. Statistics are kept; see LCR_SchedResetStats().
+ *
+ */
+{
+    NumEvents = 0;
+}
+
+extern "C" int LCR_SchedAdd(unsigned long long deadline, int action, unsigned int param)
+/**
+ * This API does not send any commands to the controller.
+ * It appends an event to the schedule and encodes its command. Events run in the order they are added,
+ * so deadlines must not decrease.
+ *
+ * @param   deadline - I - absolute time in nanoseconds, see LCR_SchedNow()
+ * @param   action - I - SCHED_ACTION_xxx
+ * @param   param - I - image index for SCHED_ACTION_SPLASH, ignored otherwise
+ *
+ * @return  >=0 = index of the event    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    SCHED_EVENT *pEvent;
+    int ret;
+
+    if(NumEvents >= SCHED_MAX_EVENTS)
+        return -1;
+
+    if(NumEvents > 0 && deadline < Events[NumEvents - 1].Deadline)
+        return -1;
+
+    pEvent = &Events[NumEvents];
+    switch(action)
+    {
+    case SCHED_ACTION_STOP:
+    case SCHED_ACTION_PAUSE:
+    case SCHED_ACTION_START:
+        ret = LCR_EncodePatternDisplay(action, pEvent->Report);
+        break;
+    case SCHED_ACTION_SPLASH:
+        ret = LCR_EncodeLoadSplash(param, pEvent->Report);
+        break;
+    default:
+        ret = -1;
+        break;
+    }
+    if(ret < 0)
+        return -1;
+
+    pEvent->Deadline = deadline;
+    pEvent->Issued = 0;
+    pEvent->Written = 0;
+    pEvent->Result = 0;
+    return NumEvents++;
+}
+
+extern "C" int LCR_SchedRun(bool realtime)
+/**
+ * This API blocks until all scheduled events have been sent. Events whose deadline has already passed
+ * are sent immediately, and their lateness is recorded like any other.
+ *
+ * @param   realtime - I - run the calling thread with real-time priority while the schedule runs, if permitted
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL (timer failure, or at least one command could not be written) <BR>
+ *
+ */
+{
+    unsigned int i;
+    unsigned long long now;
+    int timer = -1, ret = 0;
+#ifdef _WIN32
+    int oldPriority = GetThreadPriority(GetCurrentThread());
+
+    if(realtime)
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#else
+    struct sched_param oldParam, param;
+    int oldPolicy = SCHED_OTHER;
+    bool restore = false;
+
+#ifdef __linux__
+    timer = timerfd_create(CLOCK_MONOTONIC, 0);
+    if(timer < 0)
+        return -1;
+#endif
+
+    if(realtime && pthread_getschedparam(pthread_self(), &oldPolicy, &oldParam) == 0)
+    {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+        restore = (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0);
+    }
+#endif
+
+    for(i = 0; i < NumEvents; i++)
+    {
+        SCHED_EVENT *pEvent = &Events[i];
+
+        if(pEvent->Deadline > SCHED_SPIN_TIME && SCHED_SleepUntil(timer, pEvent->Deadline - SCHED_SPIN_TIME) < 0)
+        {
+            ret = -1;
+            break;
+        }
+
+        do
+        {
+            now = LCR_SchedNow();
+        } while(now < pEvent->Deadline);
+
+        pEvent->Issued = (long long)(now - pEvent->Deadline);
+        pEvent->Result = USB_WriteReport(pEvent->Report);
+        pEvent->Written = (long long)(LCR_SchedNow() - pEvent->Deadline);
+        if(pEvent->Result < 0)
+            ret = -1;
+        SCHED_Record(pEvent);
+    }
+
+#ifdef _WIN32
+    if(realtime)
+        SetThreadPriority(GetCurrentThread(), oldPriority);
+#else
+    if(restore)
+        pthread_setschedparam(pthread_self(), oldPolicy, &oldParam);
+    if(timer >= 0)
+        close(timer);
+#endif
+    return ret;
+}
+
+extern "C" int LCR_SchedGetLatency(unsigned int index, long long *pIssued, long long *pWritten)
+/**
+ * Reads back the timing achieved by an event in the last LCR_SchedRun().
+ *
+ * @param   index - I - index returned by LCR_SchedAdd()
+ * @param   pIssued - O - nanoseconds between the deadline and the start of the USB write
+ * @param   pWritten - O - nanoseconds between the deadline and the completion of the USB write
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL (bad index, or the command could not be written) <BR>
+ *
+ */
+{
+    if(index >= NumEvents)
+        return -1;
+
+    if(pIssued != NULL)
+        *pIssued = Events[index].Issued;
+    if(pWritten != NULL)
+        *pWritten = Events[index].Written;
+    return Events[index].Result < 0 ? -1 : 0;
+}
+
+extern "C" int LCR_SchedGetStats(SCHED_STATS *pStats)
+/**
+ * Reads the latency statistics accumulated over all runs since the last LCR_SchedResetStats().
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    if(pStats == NULL)
+        return -1;
+
+    *pStats = Stats;
+    return 0;
+}
+
+extern "C" void LCR_SchedResetStats(void)
+{
+    memset(&Stats, 0, sizeof(Stats));
+    LatencySum = 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * scheduler.h
+ *
+ * This module issues pattern start/stop/pause and splash load commands at absolute host times.
+ *
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "Common.h"
+#include "API.h"
+
+#define SCHED_MAX_EVENTS        256
+#define SCHED_HIST_BINS         32          /* bin 0: < 1us late, bin n: [2^(n-1), 2^n) us late */
+#define SCHED_SPIN_TIME         200000      /* nanoseconds busy-waited before each deadline */
+
+/* Event actions */
+#define SCHED_ACTION_STOP       0           /* LCR_PatternDisplay(0) */
+#define SCHED_ACTION_PAUSE      1           /* LCR_PatternDisplay(1) */
+#define SCHED_ACTION_START      2           /* LCR_PatternDisplay(2) */
+#define SCHED_ACTION_SPLASH     3           /* LCR_LoadSplash(param) */
+
+typedef struct
+{
+    long long MinLatency;       /* nanoseconds, command written minus deadline */
+    long long MaxLatency;
+    long long MeanLatency;
+    unsigned int NumEvents;
+    unsigned int NumFailed;
+    unsigned int Histogram[SCHED_HIST_BINS];
+} SCHED_STATS;
+
+extern "C" unsigned long long API_API_EXPORT LCR_SchedNow(void);
+extern "C" void API_API_EXPORT LCR_SchedClear(void);
+extern "C" int API_API_EXPORT LCR_SchedAdd(unsigned long long deadline, int action, unsigned int param);
+extern "C" int API_API_EXPORT LCR_SchedRun(bool realtime);
+extern "C" int API_API_EXPORT LCR_SchedGetLatency(unsigned int index, long long *pIssued, long long *pWritten);
+extern "C" int API_API_EXPORT LCR_SchedGetStats(SCHED_STATS *pStats);
+extern "C" void API_API_EXPORT LCR_SchedResetStats(void);
+
+#endif // SCHEDULER_H
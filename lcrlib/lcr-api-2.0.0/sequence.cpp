@@ -0,0 +1,577 @@
+/*
+ * sequence.cpp
+ *
+ * This module handles pattern sequence objects and the persistent library of named sequences.
+ *
+*/
+
+#include "sequence.h"
+#include "checksum.h"
+#include "filemap.h"
+#include <stdio.h>
+
+struct _seqLibrary
+{
+    FILEMAP Map;
+    const SEQ_LIBRARY_HEADER *pHeader;
+    const LCR_SEQUENCE *pSeqs;
+};
+
+static LCR_SEQUENCE DefaultSequence;
+static LCR_SEQUENCE *pPatLutSeq = &DefaultSequence; /* target of the LCR_xxxPatLut APIs */
+
+extern "C" int LCR_SelectPatLutSequence(LCR_SEQUENCE *pSeq)
+/**
+ * This API does not send any commands to the controller.
+ * It selects the sequence object that LCR_ClearPatLut(), LCR_AddToPatLut(), LCR_GetPatLutItem(),
+ * LCR_SendPatLut() and LCR_GetPatLut() operate on.
+ *
+ * @param   pSeq - I - sequence object to be used. NULL selects the built-in default sequence.
+ *
+ * @return  0 = PASS    <BR>
+ *
+ */
+{
+    pPatLutSeq = (pSeq != NULL) ? pSeq : &DefaultSequence;
+    return 0;
+}
+
+extern "C" LCR_SEQUENCE *LCR_GetPatLutSequence(void)
+/**
+ * @return  sequence object currently selected for the LCR_xxxPatLut APIs
+ *
+ */
+{
+    return pPatLutSeq;
+}
+
+extern "C" int LCR_SeqInit(LCR_SEQUENCE *pSeq, const char *name)
+/**
+ * This API does not send any commands to the controller.
+ * It initializes a sequence object: empty LUTs, repeat on, internal trigger, video port as pattern source.
+ * LED, trigger out and trigger in settings are left untouched on the controller until set on the sequence.
+ *
+ * @param   pSeq - O - sequence to be initialized
+ * @param   name - I - name of the sequence, truncated to SEQ_NAME_LENGTH-1 characters. May be NULL.
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    if(pSeq == NULL)
+        return -1;
+
+    memset(pSeq, 0, sizeof(LCR_SEQUENCE));
+    if(name != NULL)
+        strncpy(pSeq->Name, name, SEQ_NAME_LENGTH - 1);
+
+    pSeq->Repeat = 1;
+    pSeq->ExternalSource = 1;
+    pSeq->TriggerMode = 1;
+    pSeq->NumPatsForTrigOut2 = 1;
+    pSeq->LedEnables = SEQ_LED_SEQ_CTRL;
+    pSeq->TrigOut1Rising = 0xBB;
+    pSeq->TrigOut1Falling = 0xBB;
+    pSeq->TrigOut2Rising = 0xBB;
+    return 0;
+}
+
+extern "C" LCR_SEQUENCE *LCR_SeqCreate(const char *name)
+/**
+ * This API does not send any commands to the controller.
+ * It allocates and initializes a sequence object. See LCR_SeqInit().
+ *
+ * @param   name - I - name of the sequence
+ *
+ * @return  pointer to the new sequence, to be released with LCR_SeqDestroy() <BR>
+ *          NULL = FAIL  <BR>
+ *
+ */
+{
+    LCR_SEQUENCE *pSeq;
+
+    pSeq = (LCR_SEQUENCE *)malloc(sizeof(LCR_SEQUENCE));
+    if(pSeq == NULL)
+        return NULL;
+
+    LCR_SeqInit(pSeq, name);
+    return pSeq;
+}
+
+extern "C" void LCR_SeqDestroy(LCR_SEQUENCE *pSeq)
+/**
+ * Releases a sequence object allocated with LCR_SeqCreate().
+ * If the sequence is selected for the LCR_xxxPatLut APIs, the default sequence is selected instead.
+ *
+ */
+{
+    if(pSeq == NULL)
+        return;
+
+    if(pPatLutSeq == pSeq)
+        pPatLutSeq = &DefaultSequence;
+    free(pSeq);
+}
+
+extern "C" int LCR_SeqClearPatLut(LCR_SEQUENCE *pSeq)
+/**
+ * This API does not send any commands to the controller. It clears the pattern LUT of the sequence.
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    if(pSeq == NULL)
+        return -1;
+
+    pSeq->NumPatLutEntries = 0;
+    return 0;
+}
+
+extern "C" int LCR_SeqAddToPatLut(LCR_SEQUENCE *pSeq, int TrigType, int PatNum,int BitDepth,int LEDSelect,bool InvertPat, bool InsertBlack,bool BufSwap, bool trigOutPrev)
+/**
+ * This API does not send any commands to the controller.
+ * It appends an entry to the pattern LUT of the sequence. See LCR_AddToPatLut() for the description of the arguments.
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    unsigned int lutWord = 0;
+
+    if(pSeq == NULL || pSeq->NumPatLutEntries >= SEQ_MAX_PAT_LUT_ENTRIES)
+        return -1;
+
+    lutWord = TrigType & 3;
+    if(PatNum > 24)
+        return -1;
+
+    lutWord |= ((PatNum & 0x3F) << 2);
+    if( (BitDepth > 8) || (BitDepth <= 0))
+        return -1;
+    lutWord |= ((BitDepth & 0xF) << 8);
+    if(LEDSelect > 7)
+        return -1;
+    lutWord |= ((LEDSelect & 0x7) << 12);
+    if(InvertPat)
+        lutWord |= BIT16;
+    if(InsertBlack)
+        lutWord |= BIT17;
+    if(BufSwap)
+        lutWord |= BIT18;
+    if(trigOutPrev)
+        lutWord |= BIT19;
+
+    pSeq->PatLut[pSeq->NumPatLutEntries++] = lutWord;
+    return 0;
+}
+
+extern "C" int LCR_SeqSetSplashLut(LCR_SEQUENCE *pSeq, const unsigned char *lutEntries, unsigned int numEntries)
+/**
+ * This API does not send any commands to the controller. It sets the image LUT of the sequence.
+ *
+ * @param   lutEntries - I - image indices
+ * @param   numEntries - I - number of entries (range 0 through 64). 0 for sequences fed from the video port.
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    if(pSeq == NULL || numEntries > SEQ_MAX_SPLASH_LUT_ENTRIES)
+        return -1;
+
+    if(numEntries)
+        memcpy(pSeq->SplashLut, lutEntries, numEntries);
+    pSeq->NumSplashLutEntries = numEntries;
+    return 0;
+}
+
+extern "C" int LCR_SeqSetPatternConfig(LCR_SEQUENCE *pSeq, bool repeat, unsigned int numPatsForTrigOut2, bool external, bool triggerMode)
+/**
+ * This API does not send any commands to the controller.
+ * It sets the pattern configuration of the sequence. The number of LUT entries is taken from the pattern LUT
+ * and the number of image LUT entries from the image LUT of the sequence.
+ *
+ * @param   repeat - I - see LCR_SetPatternConfig()
+ * @param   numPatsForTrigOut2 - I - see LCR_SetPatternConfig()
+ * @param   external - I - see LCR_SetPatternDisplayMode()
+ * @param   triggerMode - I - see LCR_SetPatternTriggerMode()
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    if(pSeq == NULL || numPatsForTrigOut2 < 1 || numPatsForTrigOut2 > 256)
+        return -1;
+
+    pSeq->Repeat = repeat;
+    pSeq->NumPatsForTrigOut2 = numPatsForTrigOut2;
+    pSeq->ExternalSource = external;
+    pSeq->TriggerMode = triggerMode;
+    return 0;
+}
+
+extern "C" int LCR_SeqSetExposure_FramePeriod(LCR_SEQUENCE *pSeq, unsigned int exposurePeriod, unsigned int framePeriod)
+/**
+ * This API does not send any commands to the controller. See LCR_SetExposure_FramePeriod().
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    if(pSeq == NULL)
+        return -1;
+
+    pSeq->ExposurePeriod = exposurePeriod;
+    pSeq->FramePeriod = framePeriod;
+    return 0;
+}
+
+extern "C" int LCR_SeqSetTrigOutConfig(LCR_SEQUENCE *pSeq, unsigned int trigOutNum, bool invert, unsigned int rising, unsigned int falling)
+/**
+ * This API does not send any commands to the controller. See LCR_SetTrigOutConfig().
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    if(pSeq == NULL)
+        return -1;
+
+    if(trigOutNum == 1)
+    {
+        pSeq->TrigOut1Invert = invert;
+        pSeq->TrigOut1Rising = rising;
+        pSeq->TrigOut1Falling = falling;
+    }
+    else if(trigOutNum == 2)
+    {
+        pSeq->TrigOut2Invert = invert;
+        pSeq->TrigOut2Rising = rising;
+    }
+    else
+        return -1;
+
+    pSeq->Flags |= SEQ_FLAG_TRIG_OUT;
+    return 0;
+}
+
+extern "C" int LCR_SeqSetTrigIn1Delay(LCR_SEQUENCE *pSeq, unsigned int Delay)
+/**
+ * This API does not send any commands to the controller. See LCR_SetTrigIn1Delay().
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    if(pSeq == NULL)
+        return -1;
+
+    pSeq->TrigIn1Delay = Delay;
+    pSeq->Flags |= SEQ_FLAG_TRIG_IN;
+    return 0;
+}
+
+extern "C" int LCR_SeqSetLeds(LCR_SEQUENCE *pSeq, bool SeqCtrl, bool Red, bool Green, bool Blue, unsigned char RedCurrent, unsigned char GreenCurrent, unsigned char BlueCurrent)
+/**
+ * This API does not send any commands to the controller. See LCR_SetLedEnables() and LCR_SetLedCurrents().
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    if(pSeq == NULL)
+        return -1;
+
+    pSeq->LedEnables = 0;
+    if(Red)
+        pSeq->LedEnables |= SEQ_LED_RED;
+    if(Green)
+        pSeq->LedEnables |= SEQ_LED_GREEN;
+    if(Blue)
+        pSeq->LedEnables |= SEQ_LED_BLUE;
+    if(SeqCtrl)
+        pSeq->LedEnables |= SEQ_LED_SEQ_CTRL;
+
+    pSeq->LedCurrent[0] = RedCurrent;
+    pSeq->LedCurrent[1] = GreenCurrent;
+    pSeq->LedCurrent[2] = BlueCurrent;
+    pSeq->Flags |= SEQ_FLAG_LEDS;
+    return 0;
+}
+
+extern "C" int LCR_SendSequence(const LCR_SEQUENCE *pSeq, unsigned int *pStatus)
+/**
+ * This API stops the pattern sequence, programs all the settings held by the sequence into the controller and
+ * validates the result. The sequence is not started; use LCR_PatternDisplay(2) for that.
+ * The sequence may point directly into a library opened with LCR_SeqLibOpen().
+ *
+ * @param   pSeq - I - sequence to be programmed
+ * @param   pStatus - O - validation status, see LCR_ValidatePatLutData(). May be NULL.
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    unsigned int status;
+
+    if(pSeq == NULL || pSeq->NumPatLutEntries < 1 || pSeq->NumPatLutEntries > SEQ_MAX_PAT_LUT_ENTRIES ||
+       pSeq->NumSplashLutEntries > SEQ_MAX_SPLASH_LUT_ENTRIES)
+        return -1;
+
+    if(LCR_PatternDisplay(0) < 0)
+        return -1;
+
+    if(LCR_SetPatternDisplayMode(pSeq->ExternalSource != 0) < 0)
+        return -1;
+
+    if(LCR_SetPatternConfig(pSeq->NumPatLutEntries, pSeq->Repeat != 0, pSeq->NumPatsForTrigOut2,
+                            MAX(pSeq->NumSplashLutEntries, 1)) < 0)
+        return -1;
+
+    if(LCR_SetExposure_FramePeriod(pSeq->ExposurePeriod, pSeq->FramePeriod) < 0)
+        return -1;
+
+    if(LCR_SetPatternTriggerMode(pSeq->TriggerMode != 0) < 0)
+        return -1;
+
+    if(pSeq->Flags & SEQ_FLAG_TRIG_OUT)
+    {
+        if(LCR_SetTrigOutConfig(1, pSeq->TrigOut1Invert != 0, pSeq->TrigOut1Rising, pSeq->TrigOut1Falling) < 0)
+            return -1;
+        if(LCR_SetTrigOutConfig(2, pSeq->TrigOut2Invert != 0, pSeq->TrigOut2Rising, 0) < 0)
+            return -1;
+    }
+
+    if(pSeq->Flags & SEQ_FLAG_TRIG_IN)
+    {
+        if(LCR_SetTrigIn1Delay(pSeq->TrigIn1Delay) < 0)
+            return -1;
+    }
+
+    if(pSeq->Flags & SEQ_FLAG_LEDS)
+    {
+        if(LCR_SetLedEnables((pSeq->LedEnables & SEQ_LED_SEQ_CTRL) != 0, (pSeq->LedEnables & SEQ_LED_RED) != 0,
+                             (pSeq->LedEnables & SEQ_LED_GREEN) != 0, (pSeq->LedEnables & SEQ_LED_BLUE) != 0) < 0)
+            return -1;
+        if(LCR_SetLedCurrents(pSeq->LedCurrent[0], pSeq->LedCurrent[1], pSeq->LedCurrent[2]) < 0)
+            return -1;
+    }
+
+    if(LCR_SendPatLutWords(pSeq->PatLut, pSeq->NumPatLutEntries) < 0)
+        return -1;
+
+    if(!pSeq->ExternalSource && pSeq->NumSplashLutEntries > 0)
+    {
+        if(LCR_SendSplashLut((unsigned char *)pSeq->SplashLut, pSeq->NumSplashLutEntries) < 0)
+            return -1;
+    }
+
+    if(LCR_ValidatePatLutData(&status) < 0)
+        return -1;
+
+    if(pStatus != NULL)
+        *pStatus = status;
+    return 0;
+}
+
+extern "C" int LCR_SeqLibSave(const char *path, const LCR_SEQUENCE * const *pSeqs, unsigned int numSeqs)
+/**
+ * Writes a library file holding the given sequences. The file is written next to the destination and then
+ * renamed over it, so libraries currently opened with LCR_SeqLibOpen() keep their old content.
+ *
+ * @param   path - I - library file to be written
+ * @param   pSeqs - I - array of pointers to the sequences
+ * @param   numSeqs - I - number of sequences
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    SEQ_LIBRARY_HEADER header;
+    char tempPath[1024];
+    uint32 crc = CHKSUM_CRC32_INIT;
+    unsigned int i;
+    FILE *fp;
+
+    if(path == NULL || (numSeqs > 0 && pSeqs == NULL))
+        return -1;
+
+    for(i = 0; i < numSeqs; i++)
+    {
+        if(pSeqs[i] == NULL)
+            return -1;
+        crc = CHKSUM_Crc32Update(crc, (const uint8 *)pSeqs[i], sizeof(LCR_SEQUENCE));
+    }
+
+    header.Signature = SEQ_LIBRARY_SIGNATURE;
+    header.Version = SEQ_LIBRARY_VERSION;
+    header.RecordSize = sizeof(LCR_SEQUENCE);
+    header.NumSequences = numSeqs;
+    header.Checksum = ~crc;
+
+    if(snprintf(tempPath, sizeof(tempPath), "%s.tmp", path) >= (int)sizeof(tempPath))
+        return -1;
+
+    fp = fopen(tempPath, "wb");
+    if(fp == NULL)
+        return -1;
+
+    if(fwrite(&header, sizeof(header), 1, fp) != 1)
+    {
+        fclose(fp);
+        remove(tempPath);
+        return -1;
+    }
+
+    for(i = 0; i < numSeqs; i++)
+    {
+        if(fwrite(pSeqs[i], sizeof(LCR_SEQUENCE), 1, fp) != 1)
+        {
+            fclose(fp);
+            remove(tempPath);
+            return -1;
+        }
+    }
+
+    if(fclose(fp) != 0)
+    {
+        remove(tempPath);
+        return -1;
+    }
+
+#ifdef _WIN32
+    remove(path);
+#endif
+    if(rename(tempPath, path) != 0)
+    {
+        remove(tempPath);
+        return -1;
+    }
+    return 0;
+}
+
+extern "C" LCR_SEQUENCE_LIBRARY *LCR_SeqLibOpen(const char *path)
+/**
+ * Memory-maps a library file written by LCR_SeqLibSave() and validates its header and checksum.
+ * The sequences are accessed in place; nothing is copied or parsed.
+ *
+ * @param   path - I - library file
+ *
+ * @return  library handle, to be released with LCR_SeqLibClose() <BR>
+ *          NULL = FAIL  <BR>
+ *
+ */
+{
+    LCR_SEQUENCE_LIBRARY *pLib;
+    const SEQ_LIBRARY_HEADER *pHeader;
+    uint32 recordsSize;
+
+    pLib = (LCR_SEQUENCE_LIBRARY *)malloc(sizeof(LCR_SEQUENCE_LIBRARY));
+    if(pLib == NULL)
+        return NULL;
+
+    if(FILEMAP_Open(&pLib->Map, path) < 0)
+    {
+        free(pLib);
+        return NULL;
+    }
+
+    if(pLib->Map.Size < sizeof(SEQ_LIBRARY_HEADER))
+        goto fail;
+
+    pHeader = (const SEQ_LIBRARY_HEADER *)pLib->Map.Data;
+    if(pHeader->Signature != SEQ_LIBRARY_SIGNATURE || pHeader->Version != SEQ_LIBRARY_VERSION ||
+       pHeader->RecordSize != sizeof(LCR_SEQUENCE))
+        goto fail;
+
+    if(pHeader->NumSequences > (pLib->Map.Size - sizeof(SEQ_LIBRARY_HEADER)) / sizeof(LCR_SEQUENCE))
+        goto fail;
+
+    recordsSize = pHeader->NumSequences * sizeof(LCR_SEQUENCE);
+    if(CHKSUM_Crc32(pLib->Map.Data + sizeof(SEQ_LIBRARY_HEADER), recordsSize) != pHeader->Checksum)
+        goto fail;
+
+    pLib->pHeader = pHeader;
+    pLib->pSeqs = (const LCR_SEQUENCE *)(pLib->Map.Data + sizeof(SEQ_LIBRARY_HEADER));
+    return pLib;
+
+fail:
+    FILEMAP_Close(&pLib->Map);
+    free(pLib);
+    return NULL;
+}
+
+extern "C" void LCR_SeqLibClose(LCR_SEQUENCE_LIBRARY *pLib)
+/**
+ * Unmaps a library opened with LCR_SeqLibOpen(). Sequences obtained from it must no longer be used.
+ *
+ */
+{
+    if(pLib == NULL)
+        return;
+
+    FILEMAP_Close(&pLib->Map);
+    free(pLib);
+}
+
+extern "C" int LCR_SeqLibCount(const LCR_SEQUENCE_LIBRARY *pLib)
+/**
+ * @return  number of sequences in the library <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    if(pLib == NULL)
+        return -1;
+
+    return pLib->pHeader->NumSequences;
+}
+
+extern "C" const LCR_SEQUENCE *LCR_SeqLibGet(const LCR_SEQUENCE_LIBRARY *pLib, unsigned int index)
+/**
+ * @param   index - I - index of the sequence in the library
+ *
+ * @return  pointer to the sequence inside the mapped library <BR>
+ *          NULL = FAIL  <BR>
+ *
+ */
+{
+    if(pLib == NULL || index >= pLib->pHeader->NumSequences)
+        return NULL;
+
+    return &pLib->pSeqs[index];
+}
+
+extern "C" const LCR_SEQUENCE *LCR_SeqLibFind(const LCR_SEQUENCE_LIBRARY *pLib, const char *name)
+/**
+ * @param   name - I - name of the sequence
+ *
+ * @return  pointer to the first sequence with the given name inside the mapped library <BR>
+ *          NULL = not found  <BR>
+ *
+ */
+{
+    uint32 i;
+
+    if(pLib == NULL || name == NULL)
+        return NULL;
+
+    for(i = 0; i < pLib->pHeader->NumSequences; i++)
+    {
+        if(strncmp(pLib->pSeqs[i].Name, name, SEQ_NAME_LENGTH) == 0)
+            return &pLib->pSeqs[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,95 @@
+/*
+ * sequence.h
+ *
+ * This module handles pattern sequence objects and the persistent library of named sequences.
+ *
+ * A sequence holds everything needed to (re)program the pattern sequencer: pattern LUT words,
+ * image (splash) LUT, pattern configuration, exposure/frame period, trigger and LED settings.
+ * Sequences are plain fixed-size records so that a library file can be memory-mapped and its
+ * records handed directly to LCR_SendSequence().
+ *
+*/
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include "Common.h"
+#include "API.h"
+
+#define SEQ_MAX_PAT_LUT_ENTRIES     128
+#define SEQ_MAX_SPLASH_LUT_ENTRIES  64
+#define SEQ_NAME_LENGTH             32
+
+#define SEQ_LIBRARY_SIGNATURE       0x5145534C  /* "LSEQ" */
+#define SEQ_LIBRARY_VERSION         1
+
+/* Flags bits: optional settings programmed by LCR_SendSequence() */
+#define SEQ_FLAG_LEDS               BIT0
+#define SEQ_FLAG_TRIG_OUT           BIT1
+#define SEQ_FLAG_TRIG_IN            BIT2
+
+/* LedEnables bits */
+#define SEQ_LED_RED                 BIT0
+#define SEQ_LED_GREEN               BIT1
+#define SEQ_LED_BLUE                BIT2
+#define SEQ_LED_SEQ_CTRL            BIT3
+
+typedef struct
+{
+    char    Name[SEQ_NAME_LENGTH];                  /* zero terminated */
+    uint32  PatLut[SEQ_MAX_PAT_LUT_ENTRIES];        /* 24-bit LUT words, see LCR_AddToPatLut() */
+    uint32  NumPatLutEntries;
+    uint8   SplashLut[SEQ_MAX_SPLASH_LUT_ENTRIES];  /* image indices, see LCR_SendSplashLut() */
+    uint32  NumSplashLutEntries;
+    uint32  NumPatsForTrigOut2;
+    uint32  ExposurePeriod;                         /* microseconds */
+    uint32  FramePeriod;                            /* microseconds */
+    uint32  TrigIn1Delay;
+    uint8   Repeat;
+    uint8   ExternalSource;                         /* see LCR_SetPatternDisplayMode() */
+    uint8   TriggerMode;                            /* see LCR_SetPatternTriggerMode() */
+    uint8   LedEnables;                             /* SEQ_LED_xxx bits */
+    uint8   LedCurrent[3];                          /* red, green, blue */
+    uint8   TrigOut1Invert;
+    uint8   TrigOut1Rising;
+    uint8   TrigOut1Falling;
+    uint8   TrigOut2Invert;
+    uint8   TrigOut2Rising;
+    uint8   Flags;                                  /* SEQ_FLAG_xxx bits */
+    uint8   Reserved[3];
+} LCR_SEQUENCE;
+
+typedef struct
+{
+    uint32  Signature;      /* SEQ_LIBRARY_SIGNATURE */
+    uint16  Version;        /* SEQ_LIBRARY_VERSION */
+    uint16  RecordSize;     /* sizeof(LCR_SEQUENCE) */
+    uint32  NumSequences;
+    uint32  Checksum;       /* CRC-32 of all the sequence records following the header */
+} SEQ_LIBRARY_HEADER;
+
+typedef struct _seqLibrary LCR_SEQUENCE_LIBRARY;
+
+extern "C" LCR_SEQUENCE API_API_EXPORT *LCR_SeqCreate(const char *name);
+extern "C" void API_API_EXPORT LCR_SeqDestroy(LCR_SEQUENCE *pSeq);
+extern "C" int API_API_EXPORT LCR_SeqInit(LCR_SEQUENCE *pSeq, const char *name);
+extern "C" int API_API_EXPORT LCR_SeqClearPatLut(LCR_SEQUENCE *pSeq);
+extern "C" int API_API_EXPORT LCR_SeqAddToPatLut(LCR_SEQUENCE *pSeq, int TrigType, int PatNum,int BitDepth,int LEDSelect,bool InvertPat, bool InsertBlack,bool BufSwap, bool trigOutPrev);
+extern "C" int API_API_EXPORT LCR_SeqSetSplashLut(LCR_SEQUENCE *pSeq, const unsigned char *lutEntries, unsigned int numEntries);
+extern "C" int API_API_EXPORT LCR_SeqSetPatternConfig(LCR_SEQUENCE *pSeq, bool repeat, unsigned int numPatsForTrigOut2, bool external, bool triggerMode);
+extern "C" int API_API_EXPORT LCR_SeqSetExposure_FramePeriod(LCR_SEQUENCE *pSeq, unsigned int exposurePeriod, unsigned int framePeriod);
+extern "C" int API_API_EXPORT LCR_SeqSetTrigOutConfig(LCR_SEQUENCE *pSeq, unsigned int trigOutNum, bool invert, unsigned int rising, unsigned int falling);
+extern "C" int API_API_EXPORT LCR_SeqSetLeds(LCR_SEQUENCE *pSeq, bool SeqCtrl, bool Red, bool Green, bool Blue, unsigned char RedCurrent, unsigned char GreenCurrent, unsigned char BlueCurrent);
+extern "C" int API_API_EXPORT LCR_SeqSetTrigIn1Delay(LCR_SEQUENCE *pSeq, unsigned int Delay);
+extern "C" int API_API_EXPORT LCR_SelectPatLutSequence(LCR_SEQUENCE *pSeq);
+extern "C" LCR_SEQUENCE API_API_EXPORT *LCR_GetPatLutSequence(void);
+extern "C" int API_API_EXPORT LCR_SendSequence(const LCR_SEQUENCE *pSeq, unsigned int *pStatus);
+
+extern "C" int API_API_EXPORT LCR_SeqLibSave(const char *path, const LCR_SEQUENCE * const *pSeqs, unsigned int numSeqs);
+extern "C" LCR_SEQUENCE_LIBRARY API_API_EXPORT *LCR_SeqLibOpen(const char *path);
+extern "C" void API_API_EXPORT LCR_SeqLibClose(LCR_SEQUENCE_LIBRARY *pLib);
+extern "C" int API_API_EXPORT LCR_SeqLibCount(const LCR_SEQUENCE_LIBRARY *pLib);
+extern "C" const LCR_SEQUENCE API_API_EXPORT *LCR_SeqLibGet(const LCR_SEQUENCE_LIBRARY *pLib, unsigned int index);
+extern "C" const LCR_SEQUENCE API_API_EXPORT *LCR_SeqLibFind(const LCR_SEQUENCE_LIBRARY *pLib, const char *name);
+
+#endif // SEQUENCE_H
@@ -0,0 +1,209 @@
+/*
+ * splashcache.cpp
+ *
+ * This module keeps compressed splash blobs in a directory on disk, keyed by the content of the
+ * source image, so firmware rebuilds only compress the images that changed.
+ *
+ * Every blob is a file named after the 64-bit hash of its key and its tag. The file starts with
+ * a SPLCACHE_ENTRY that also holds the size and a differently seeded hash of the key, and the
+ * hash of the blob, so a hash collision or a damaged file is a miss rather than a wrong image.
+ * Files are written under a temporary name and renamed, so concurrent builds sharing a directory
+ * never read a partial blob.
+ *
+*/
+
+#include "splashcache.h"
+#include "checksum.h"
+#include "threadpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <direct.h>
+    #include <process.h>
+    #define SPLCACHE_GetPid()       _getpid()
+    #define SPLCACHE_MakeDir(dir)   _mkdir(dir)
+#else
+    #include <unistd.h>
+    #define SPLCACHE_GetPid()       getpid()
+    #define SPLCACHE_MakeDir(dir)   mkdir(dir, 0777)
+#endif
+
+static volatile long SplcacheTempCount;
+
+static int SPLCACHE_EntryPath(char *path, uint32 pathSize, const char *dir, const uint8 *pKey, uint32 keySize, uint32 tag)
+{
+    unsigned long long hash = CHKSUM_Hash64(pKey, keySize, 0);
+
+    if(snprintf(path, pathSize, "%s/%016llx-%08x.spc", dir, hash, tag) >= (int)pathSize)
+        return -1;
+    return 0;
+}
+
+int SPLCACHE_Init(const char *dir)
+/**
+ * Creates the cache directory if it doesn't exist yet. Its parent must exist.
+ *
+ * @param   dir - I - cache directory
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL <BR>
+ *
+ */
+{
+    struct stat st;
+
+    if(stat(dir, &st) == 0)
+        return (st.st_mode & S_IFDIR) ? 0 : -1;
+
+    if(SPLCACHE_MakeDir(dir) != 0 && errno != EEXIST)
+        return -1;
+    return 0;
+}
+
+int SPLCACHE_Lookup(const char *dir, const uint8 *pKey, uint32 keySize, uint32 tag, uint8 **ppBlob, uint32 *pBlobSize,
+                    unsigned long long *pBlobHash)
+/**
+ * Looks up the blob stored for a key and tag.
+ *
+ * @param   dir - I - cache directory
+ * @param   pKey - I - key, e.g. the source image
+ * @param   keySize - I - size of the key in bytes
+ * @param   tag - I - encoding parameters the blob depends on
+ * @param   ppBlob - O - the blob, to be freed by the caller
+ * @param   pBlobSize - O - size of the blob in bytes
+ * @param   pBlobHash - O - CHKSUM_Hash64 of the second part of the blob seeded with the hash of the
+ *                          first, see SPLCACHE_Store
+ *
+ * @return  0 = found <BR>
+ *          -1 = not cached or the cached file is damaged <BR>
+ *
+ */
+{
+    SPLCACHE_ENTRY entry;
+    char path[1024];
+    uint8 *pBlob;
+    unsigned long long hash;
+    FILE *fp;
+
+    if(SPLCACHE_EntryPath(path, sizeof(path), dir, pKey, keySize, tag) < 0)
+        return -1;
+
+    fp = fopen(path, "rb");
+    if(fp == NULL)
+        return -1;
+
+    if(fread(&entry, sizeof(entry), 1, fp) != 1 ||
+       entry.Signature != SPLCACHE_SIGNATURE || entry.Version != SPLCACHE_VERSION ||
+       CHKSUM_Crc32((const uint8 *)&entry, offsetof(SPLCACHE_ENTRY, Checksum)) != entry.Checksum ||
+       entry.Tag != tag || entry.KeySize != keySize || entry.Part1Size > entry.BlobSize ||
+       entry.KeyHash != CHKSUM_Hash64(pKey, keySize, SPLCACHE_KEY_SEED))
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    pBlob = (uint8 *)malloc(MAX(entry.BlobSize, 1));
+    if(pBlob == NULL)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    if(fread(pBlob, 1, entry.BlobSize, fp) != entry.BlobSize)
+    {
+        free(pBlob);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    hash = CHKSUM_Hash64(pBlob, entry.Part1Size, 0);
+    hash = CHKSUM_Hash64(pBlob + entry.Part1Size, entry.BlobSize - entry.Part1Size, hash);
+    if(hash != entry.BlobHash)
+    {
+        free(pBlob);
+        return -1;
+    }
+
+    *ppBlob = pBlob;
+    *pBlobSize = entry.BlobSize;
+    *pBlobHash = hash;
+    return 0;
+}
+
+int SPLCACHE_Store(const char *dir, const uint8 *pKey, uint32 keySize, uint32 tag, const uint8 *pBlob1, uint32 size1,
+                   const uint8 *pBlob2, uint32 size2)
+/**
+ * Stores the blob for a key and tag, replacing any blob stored before. The blob is given in two
+ * parts that are stored one after the other, e.g. a header and the data following it.
+ *
+ * @param   dir - I - cache directory
+ * @param   pKey - I - key, e.g. the source image
+ * @param   keySize - I - size of the key in bytes
+ * @param   tag - I - encoding parameters the blob depends on
+ * @param   pBlob1 - I - first part of the blob
+ * @param   size1 - I - size of the first part in bytes
+ * @param   pBlob2 - I - second part of the blob
+ * @param   size2 - I - size of the second part in bytes
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL <BR>
+ *
+ */
+{
+    SPLCACHE_ENTRY entry;
+    char path[1024], tempPath[1024];
+    FILE *fp;
+
+    if(SPLCACHE_EntryPath(path, sizeof(path), dir, pKey, keySize, tag) < 0)
+        return -1;
+
+    /* Unique among the threads of this process and the other processes using the directory */
+    if(snprintf(tempPath, sizeof(tempPath), "%s.%d.%ld.tmp", path, (int)SPLCACHE_GetPid(),
+                THREAD_AtomicIncrement(&SplcacheTempCount)) >= (int)sizeof(tempPath))
+        return -1;
+
+    entry.Signature = SPLCACHE_SIGNATURE;
+    entry.Version = SPLCACHE_VERSION;
+    entry.Reserved = 0;
+    entry.Tag = tag;
+    entry.KeySize = keySize;
+    entry.KeyHash = CHKSUM_Hash64(pKey, keySize, SPLCACHE_KEY_SEED);
+    entry.BlobSize = size1 + size2;
+    entry.Part1Size = size1;
+    entry.BlobHash = CHKSUM_Hash64(pBlob2, size2, CHKSUM_Hash64(pBlob1, size1, 0));
+    entry.Reserved2 = 0;
+    entry.Checksum = CHKSUM_Crc32((const uint8 *)&entry, offsetof(SPLCACHE_ENTRY, Checksum));
+
+    fp = fopen(tempPath, "wb");
+    if(fp == NULL)
+        return -1;
+
+    if(fwrite(&entry, sizeof(entry), 1, fp) != 1 || fwrite(pBlob1, 1, size1, fp) != size1 ||
+       fwrite(pBlob2, 1, size2, fp) != size2)
+    {
+        fclose(fp);
+        remove(tempPath);
+        return -1;
+    }
+
+    if(fclose(fp) != 0)
+    {
+        remove(tempPath);
+        return -1;
+    }
+
+#ifdef _WIN32
+    remove(path);
+#endif
+    if(rename(tempPath, path) != 0)
+    {
+        remove(tempPath);
+        return -1;
+    }
+    return 0;
+}
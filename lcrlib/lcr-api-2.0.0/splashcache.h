@@ -0,0 +1,39 @@
+/*
+ * splashcache.h
+ *
+ * This module keeps compressed splash blobs in a directory on disk, keyed by the content of the
+ * source image, so firmware rebuilds only compress the images that changed.
+ *
+*/
+
+#ifndef SPLASHCACHE_H
+#define SPLASHCACHE_H
+
+#include "Common.h"
+
+#define SPLCACHE_SIGNATURE      0x43504C53  /* "SPLC" */
+#define SPLCACHE_VERSION        1
+#define SPLCACHE_KEY_SEED       0x53504C43ULL   /* seed of the key hash kept in the entry, unlike the file name's */
+
+typedef struct
+{
+    uint32  Signature;      /* SPLCACHE_SIGNATURE */
+    uint16  Version;        /* SPLCACHE_VERSION */
+    uint16  Reserved;
+    uint32  Tag;            /* encoding parameters the blob depends on besides the key */
+    uint32  KeySize;
+    unsigned long long KeyHash;     /* of the key with SPLCACHE_KEY_SEED, checked on top of the file name */
+    uint32  BlobSize;       /* size of the blob following the entry */
+    uint32  Part1Size;      /* size of the first part of the blob */
+    unsigned long long BlobHash;    /* of the second part of the blob, seeded with the hash of the first */
+    uint32  Reserved2;
+    uint32  Checksum;       /* CRC-32 of the fields above */
+} SPLCACHE_ENTRY;
+
+int SPLCACHE_Init(const char *dir);
+int SPLCACHE_Lookup(const char *dir, const uint8 *pKey, uint32 keySize, uint32 tag, uint8 **ppBlob, uint32 *pBlobSize,
+                    unsigned long long *pBlobHash);
+int SPLCACHE_Store(const char *dir, const uint8 *pKey, uint32 keySize, uint32 tag, const uint8 *pBlob1, uint32 size1,
+                   const uint8 *pBlob2, uint32 size2);
+
+#endif
@@ -0,0 +1,645 @@
+/*
+ * splashcodec.cpp
+ *
+ * This module has the splash image compression kernels used when building firmware images.
+ *
+ * The RLE encoder works on stretches of pixels instead of single pixels. A stretch is a maximal
+ * range of pixels that are all equal to their left neighbour (a run) or all different from it
+ * (literals); its end is found with SSE2/AVX2 compares of the line against itself shifted by one
+ * pixel. The kernel is selected at run time, with a scalar fallback for other CPUs.
+ *
+ * The decoder swaps the 2nd and 3rd byte of every pixel while it expands the stream, so the
+ * result goes straight to the destination. Literals are copied 5 pixels at a time with an SSSE3
+ * shuffle when available, and runs are filled by doubling the filled part with wide copies.
+ *
+*/
+
+#include "splashcodec.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__)) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CODEC_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define CODEC_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define CODEC_TARGET_AVX2   __attribute__((target("avx2")))
+#define CODEC_TARGET_SSSE3  __attribute__((target("ssse3")))
+#else
+#define CODEC_TARGET_AVX2
+#define CODEC_TARGET_SSSE3
+#endif
+
+#define PIXEL_SIZE          3
+#define RLE_MAX_COUNT       255
+
+typedef uint32 (*SPLASH_SCAN_FUNC)(const uint8 *pLine, uint32 start, uint32 width, bool equal);
+typedef void (*SPLASH_SWAP_FUNC)(uint8 *pDst, const uint8 *pSrc, uint32 numPixels);
+
+static uint32 SPLASH_Ctz(uint32 x)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+
+    _BitScanForward(&index, x);
+    return index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+static bool SPLASH_PixelRepeats(const uint8 *pLine, uint32 i)
+{
+    const uint8 *p = pLine + i * PIXEL_SIZE;
+
+    return (p[0] == p[-3]) && (p[1] == p[-2]) && (p[2] == p[-1]);
+}
+
+static uint32 SPLASH_ScanScalar(const uint8 *pLine, uint32 start, uint32 width, bool equal)
+{
+    uint32 i;
+
+    for(i = start; i < width; i++)
+    {
+        if(SPLASH_PixelRepeats(pLine, i) == equal)
+            break;
+    }
+    return i;
+}
+
+#ifdef CODEC_SSE2
+static uint32 SPLASH_ScanSSE2(const uint8 *pLine, uint32 start, uint32 width, bool equal)
+{
+    const uint32 phase = 0x1249;    /* first byte of each of the 5 pixels in 15 bytes */
+    __m128i cur, prev;
+    uint32 m, e, i = start;
+
+    /* 16 bytes are loaded for 5 pixels, so stay one pixel away from the end of the line */
+    while(i + 6 <= width)
+    {
+        cur  = _mm_loadu_si128((const __m128i *)(pLine + i * PIXEL_SIZE));
+        prev = _mm_loadu_si128((const __m128i *)(pLine + i * PIXEL_SIZE - PIXEL_SIZE));
+        m = _mm_movemask_epi8(_mm_cmpeq_epi8(cur, prev));
+        e = m & (m >> 1) & (m >> 2) & phase;
+        if(!equal)
+            e = ~e & phase;
+        if(e)
+            return i + SPLASH_Ctz(e) / PIXEL_SIZE;
+        i += 5;
+    }
+    return SPLASH_ScanScalar(pLine, i, width, equal);
+}
+#endif
+
+#ifdef CODEC_AVX2
+CODEC_TARGET_AVX2
+static uint32 SPLASH_ScanAVX2(const uint8 *pLine, uint32 start, uint32 width, bool equal)
+{
+    const uint32 phase = 0x09249249;    /* first byte of each of the 10 pixels in 30 bytes */
+    __m256i cur, prev;
+    uint32 m, e, i = start;
+
+    /* 32 bytes are loaded for 10 pixels, so stay one pixel away from the end of the line */
+    while(i + 11 <= width)
+    {
+        cur  = _mm256_loadu_si256((const __m256i *)(pLine + i * PIXEL_SIZE));
+        prev = _mm256_loadu_si256((const __m256i *)(pLine + i * PIXEL_SIZE - PIXEL_SIZE));
+        m = (uint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(cur, prev));
+        e = m & (m >> 1) & (m >> 2) & phase;
+        if(!equal)
+            e = ~e & phase;
+        if(e)
+            return i + SPLASH_Ctz(e) / PIXEL_SIZE;
+        i += 10;
+    }
+    return SPLASH_ScanSSE2(pLine, i, width, equal);
+}
+
+static bool SPLASH_HaveAVX2(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+
+    __cpuid(info, 0);
+    if(info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    if(!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))  /* OSXSAVE, AVX */
+        return false;
+    if((_xgetbv(0) & 6) != 6)                               /* XMM and YMM state enabled by the OS */
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#ifdef CODEC_SSE2
+static bool SPLASH_HaveSSSE3(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+#endif
+
+static SPLASH_SCAN_FUNC SPLASH_SelectScan(void)
+{
+#ifdef CODEC_AVX2
+    if(SPLASH_HaveAVX2())
+        return SPLASH_ScanAVX2;
+#endif
+#ifdef CODEC_SSE2
+    return SPLASH_ScanSSE2;
+#else
+    return SPLASH_ScanScalar;
+#endif
+}
+
+static SPLASH_SCAN_FUNC SPLASH_Scan = NULL;
+
+uint32 SPLASH_FindPixelChange(const uint8 *pLine, uint32 start, uint32 width, bool equal)
+/**
+ * Finds the first pixel at or after start whose equality with its left neighbour is the given one.
+ *
+ * @param   pLine - I - line of 24-bit pixels
+ * @param   start - I - first pixel to test, must be >= 1
+ * @param   width - I - number of pixels in the line
+ * @param   equal - I - TRUE = find a pixel equal to its left neighbour; FALSE = find one that differs
+ *
+ * @return  index of the pixel, or width if there is none
+ *
+ */
+{
+    if(SPLASH_Scan == NULL)
+        SPLASH_Scan = SPLASH_SelectScan();
+
+    return SPLASH_Scan(pLine, start, width, equal);
+}
+
+static uint32 SPLASH_EmitRun(uint8 *pDst, uint32 D, uint32 repeat, const uint8 *pPixel)
+{
+    if(pDst)
+    {
+        pDst[D] = repeat;
+        memcpy(pDst + D + 1, pPixel, PIXEL_SIZE);
+    }
+    return D + 1 + PIXEL_SIZE;
+}
+
+static uint32 SPLASH_EmitLiterals(uint8 *pDst, uint32 D, uint32 count, const uint8 *pFirst)
+{
+    uint32 ctrl = count > 1 ? 2 : 1;
+
+    if(pDst)
+    {
+        if(count > 1)
+            pDst[D] = 0;
+        pDst[D + ctrl - 1] = count;
+        memcpy(pDst + D + ctrl, pFirst, count * PIXEL_SIZE);
+    }
+    return D + ctrl + count * PIXEL_SIZE;
+}
+
+static uint32 SPLASH_EmitPadding(uint8 *pDst, uint32 D, uint32 align)
+{
+    uint32 pad;
+
+    if(D % align == 0)
+        return D;
+    pad = align - (D % align);
+    if(pDst)
+        memset(pDst + D, 0, pad);
+    return D + pad;
+}
+
+/* Encodes one line, including its end of line marker. With pDst = NULL only the size is computed. */
+static uint32 SPLASH_RLEEncodeLine(const uint8 *pLine, uint8 *pDst, uint32 D, uint32 width)
+{
+    uint32 i, j, n, add;
+    uint32 Repeat, count;
+    bool first;
+
+    /* The first pixel of a line always starts a new run */
+    Repeat = 1;
+    count = 0;
+    first = false;
+
+    for(i = 1; i < width; i = j)
+    {
+        if(SPLASH_PixelRepeats(pLine, i))
+        {
+            /* Pixels i..j-1 all repeat their left neighbour */
+            j = SPLASH_FindPixelChange(pLine, i + 1, width, false);
+            n = i;
+            while(n < j)
+            {
+                if(first)
+                {
+                    Repeat = 1;
+                    first = false;
+                    n++;
+                    continue;
+                }
+                if(count)
+                {
+                    D = SPLASH_EmitLiterals(pDst, D, count, pLine + (n - 1 - count) * PIXEL_SIZE);
+                    count = 0;
+                }
+                add = MIN(RLE_MAX_COUNT - Repeat, j - n);
+                Repeat += add;
+                n += add;
+                if(Repeat == RLE_MAX_COUNT)
+                {
+                    D = SPLASH_EmitRun(pDst, D, Repeat, pLine + (n - 1) * PIXEL_SIZE);
+                    first = true;
+                }
+            }
+        }
+        else
+        {
+            /* Pixels i..j-1 all differ from their left neighbour */
+            j = SPLASH_FindPixelChange(pLine, i + 1, width, true);
+            n = i;
+            while(n < j)
+            {
+                if(first)
+                {
+                    Repeat = 1;
+                    count = 0;
+                    first = false;
+                    n++;
+                    continue;
+                }
+                if(Repeat != 1)
+                {
+                    D = SPLASH_EmitRun(pDst, D, Repeat, pLine + (n - 1) * PIXEL_SIZE);
+                    Repeat = 1;
+                    n++;
+                    continue;
+                }
+                add = MIN(RLE_MAX_COUNT - count, j - n);
+                count += add;
+                n += add;
+                if(count == RLE_MAX_COUNT)
+                {
+                    D = SPLASH_EmitLiterals(pDst, D, count, pLine + (n - 1 - count) * PIXEL_SIZE);
+                    count = 0;
+                }
+            }
+        }
+    }
+
+    /* Last pixel of the line, unless it just completed a 255 pixel run */
+    if(Repeat != RLE_MAX_COUNT)
+    {
+        if(count)
+        {
+            /* Always written with the 0,n form, even for a single literal before the last pixel */
+            if(pDst)
+            {
+                pDst[D] = 0;
+                pDst[D + 1] = count + 1;
+                memcpy(pDst + D + 2, pLine + (width - 1 - count) * PIXEL_SIZE, (count + 1) * PIXEL_SIZE);
+            }
+            D += 2 + (count + 1) * PIXEL_SIZE;
+        }
+        else
+        {
+            D = SPLASH_EmitRun(pDst, D, Repeat, pLine + (width - 1) * PIXEL_SIZE);
+        }
+    }
+
+    // END OF LINE
+    if(pDst)
+    {
+        pDst[D] = 0;
+        pDst[D + 1] = 0;
+    }
+    D += 2;
+
+    /* Scan lines are always padded out to next 32-bit boundary */
+    return SPLASH_EmitPadding(pDst, D, 4);
+}
+
+static uint32 SPLASH_RLEEndImage(uint8 *pDst, uint32 D)
+{
+    /* End of file: Control Byte = 0 & Color Byte = 1 */
+    if(pDst)
+    {
+        pDst[D] = 0;
+        pDst[D + 1] = 1;
+    }
+    D += 2;
+
+    /* End of file should be padded out till 128-bit boundary */
+    return SPLASH_EmitPadding(pDst, D, 16);
+}
+
+uint32 SPLASH_RLECompress(const uint8 *pSrc, uint8 *pDst, uint32 width, uint32 height)
+/**
+ * RLE compresses a 24-bit splash image. The output is the same stream of control bytes, runs,
+ * literals and padding that the per-pixel encoder produced: runs and literal blocks are split at
+ * 255 pixels, every line ends with 0,0 padded to 32 bits and the image ends with 0,1 padded to 128 bits.
+ *
+ * @param   pSrc - I - image, lines of width*3 bytes without padding
+ * @param   pDst - O - compressed image
+ *
+ * @return  size of the compressed image in bytes
+ *
+ */
+{
+    uint32 Row, D = 0;
+
+    for(Row = 0; Row < height; Row++)
+        D = SPLASH_RLEEncodeLine(pSrc + Row * width * PIXEL_SIZE, pDst, D, width);
+
+    return SPLASH_RLEEndImage(pDst, D);
+}
+
+uint32 SPLASH_RLEMaxSize(uint32 width, uint32 height)
+/**
+ * Every element of the RLE stream holds at least one pixel with at most one control byte per pixel,
+ * so a line never takes more than 4 bytes per pixel plus its end of line marker and padding.
+ *
+ * @return  upper bound of the size SPLASH_RLECompress produces for an image of this size
+ *
+ */
+{
+    return height * (width * (PIXEL_SIZE + 1) + 2 + 3) + 2 + 15;
+}
+
+/* Checks that line n equals line n+period for every pair of lines of the image */
+static bool SPLASH_LinesRepeat(const uint8 *pSrc, uint32 width, uint32 stride, uint32 first, uint32 last, uint32 period)
+{
+    uint32 Row;
+
+    for(Row = first; Row < last; Row++)
+    {
+        if(memcmp(pSrc + Row * stride, pSrc + (Row + period) * stride, width * PIXEL_SIZE) != 0)
+            return false;
+    }
+    return true;
+}
+
+uint32 SPLASH_EstimateCompression(const uint8 *pSrc, uint32 width, uint32 height, uint32 stride,
+                                  uint32 maxPeriod, uint32 limit, uint32 *pPeriod)
+/**
+ * Computes what the automatic compression choice needs in a single pass over the image, without
+ * writing any output: the exact size SPLASH_RLECompress would produce and the smallest number of
+ * lines the image is a repeated block of.
+ *
+ * Only powers of two are tried. An image repeating every p lines also repeats every 2p lines, so
+ * the candidate period is doubled whenever a line differs from the line p after it. Only the last
+ * lines passed are compared again for the doubled period, the others follow from the shorter one.
+ *
+ * @param   pSrc - I - image
+ * @param   width - I - image width in pixels
+ * @param   height - I - image height in lines
+ * @param   stride - I - line pitch used for the repeat check. RLE sizing uses width*3, as SPLASH_RLECompress does.
+ * @param   maxPeriod - I - longest repeat period of interest in lines, a power of two
+ * @param   limit - I - stop sizing RLE once the size reaches this many bytes
+ * @param   pPeriod - O - smallest period p <= maxPeriod with line n equal to line n+p for all lines, 0 if none
+ *
+ * @return  RLE compressed size, or a value >= limit if the RLE stream would not be smaller than limit
+ *
+ */
+{
+    uint32 Row, D = 0, period = 1, known, first, last;
+
+    if(maxPeriod == 0)
+        period = 0;
+
+    for(Row = 0; Row < height; Row++)
+    {
+        if(D < limit)
+            D = SPLASH_RLEEncodeLine(pSrc + Row * width * PIXEL_SIZE, NULL, D, width);
+
+        while(period != 0 && Row + period < height &&
+              memcmp(pSrc + Row * stride, pSrc + (Row + period) * stride, width * PIXEL_SIZE) != 0)
+        {
+            /* A line before Row - period + known reaches its line period later in steps of known lines */
+            known = period;
+            do
+            {
+                period *= 2;
+                if(period > maxPeriod)
+                {
+                    period = 0;
+                    break;
+                }
+                first = Row + known > period ? Row + known - period : 0;
+                last = height > period ? MIN(Row, height - period) : 0;
+            }
+            while(!SPLASH_LinesRepeat(pSrc, width, stride, first, last, period));
+        }
+
+        if(D >= limit && period == 0)
+            break;
+    }
+
+    *pPeriod = period;
+    if(D >= limit)
+        return D;
+    return SPLASH_RLEEndImage(NULL, D);
+}
+
+static void SPLASH_SwapCopyScalar(uint8 *pDst, const uint8 *pSrc, uint32 numPixels)
+{
+    uint32 i;
+
+    for(i = 0; i < numPixels; i++, pDst += PIXEL_SIZE, pSrc += PIXEL_SIZE)
+    {
+        pDst[0] = pSrc[0];
+        pDst[1] = pSrc[2];
+        pDst[2] = pSrc[1];
+    }
+}
+
+#ifdef CODEC_SSE2
+static const uint8 SwapShuffle[16] = {0, 2, 1, 3, 5, 4, 6, 8, 7, 9, 11, 10, 12, 14, 13, 15};
+
+CODEC_TARGET_SSSE3
+static void SPLASH_SwapCopySSSE3(uint8 *pDst, const uint8 *pSrc, uint32 numPixels)
+{
+    const __m128i shuffle = _mm_loadu_si128((const __m128i *)SwapShuffle);
+    uint32 i = 0;
+
+    /* 16 bytes are stored for 5 pixels, so stay one pixel away from the end */
+    while(i + 6 <= numPixels)
+    {
+        _mm_storeu_si128((__m128i *)(pDst + i * PIXEL_SIZE),
+                         _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pSrc + i * PIXEL_SIZE)), shuffle));
+        i += 5;
+    }
+    SPLASH_SwapCopyScalar(pDst + i * PIXEL_SIZE, pSrc + i * PIXEL_SIZE, numPixels - i);
+}
+
+/* Same, but may read and write up to 15 bytes past the end of the pixels */
+CODEC_TARGET_SSSE3
+static void SPLASH_SwapCopyOverrunSSSE3(uint8 *pDst, const uint8 *pSrc, uint32 numPixels)
+{
+    const __m128i shuffle = _mm_loadu_si128((const __m128i *)SwapShuffle);
+    uint32 i;
+
+    for(i = 0; i < numPixels; i += 5)
+        _mm_storeu_si128((__m128i *)(pDst + i * PIXEL_SIZE),
+                         _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pSrc + i * PIXEL_SIZE)), shuffle));
+}
+#endif
+
+static SPLASH_SWAP_FUNC SPLASH_SwapCopy = NULL;
+
+void SPLASH_CopyPixelsSwapped(uint8 *pDst, const uint8 *pSrc, uint32 numPixels)
+/**
+ * Copies 24-bit pixels, swapping the 2nd and 3rd byte of each. This converts between the byte
+ * order of bitmap files and the one used in splash images, in either direction.
+ *
+ * @param   pDst - O - destination, must not overlap pSrc
+ * @param   pSrc - I - source pixels
+ * @param   numPixels - I - number of pixels
+ *
+ */
+{
+    if(SPLASH_SwapCopy == NULL)
+    {
+#ifdef CODEC_SSE2
+        SPLASH_SwapCopy = SPLASH_HaveSSSE3() ? SPLASH_SwapCopySSSE3 : SPLASH_SwapCopyScalar;
+#else
+        SPLASH_SwapCopy = SPLASH_SwapCopyScalar;
+#endif
+    }
+    SPLASH_SwapCopy(pDst, pSrc, numPixels);
+}
+
+/* Fills count pixels with the given pixel. May write up to 47 bytes past the end of the run. */
+static void SPLASH_FillRunOverrun(uint8 *pDst, uint32 pixel, uint32 count)
+{
+    /* The 48 byte pattern of 16 pixels, as 8 byte words starting at pixel phase 0, 2 and 1 */
+    unsigned long long p0 = pixel;
+    unsigned long long p1 = (pixel >> 8) | ((pixel & 0xFF) << 16);
+    unsigned long long p2 = (pixel >> 16) | ((pixel & 0xFFFF) << 8);
+    unsigned long long w0 = p0 | (p0 << 24) | (p0 << 48);
+    unsigned long long w1 = p2 | (p2 << 24) | (p2 << 48);
+    unsigned long long w2 = p1 | (p1 << 24) | (p1 << 48);
+    uint32 i;
+
+#ifdef CODEC_SSE2
+    const __m128i a = _mm_set_epi64x((long long)w1, (long long)w0);
+    const __m128i b = _mm_set_epi64x((long long)w0, (long long)w2);
+    const __m128i c = _mm_set_epi64x((long long)w2, (long long)w1);
+
+    for(i = 0; i < count; i += 16, pDst += 48)
+    {
+        _mm_storeu_si128((__m128i *)pDst, a);
+        _mm_storeu_si128((__m128i *)(pDst + 16), b);
+        _mm_storeu_si128((__m128i *)(pDst + 32), c);
+    }
+#else
+    for(i = 0; i < count; i += 8, pDst += 24)
+    {
+        memcpy(pDst, &w0, 8);
+        memcpy(pDst + 8, &w1, 8);
+        memcpy(pDst + 16, &w2, 8);
+    }
+#endif
+}
+
+int SPLASH_RLEDecode(const uint8 *pSrc, uint32 srcSize, uint8 *pDst, uint32 dstSize, uint32 *pDecodedSize)
+/**
+ * Decodes an RLE compressed splash image and swaps the 2nd and 3rd byte of every pixel in the
+ * same pass, giving the pixel byte order of the bitmap the image was made from.
+ *
+ * @param   pSrc - I - compressed image, starting at a 32-bit boundary of the stream
+ * @param   srcSize - I - size of the compressed image
+ * @param   pDst - O - decoded pixels, lines of width*3 bytes without padding
+ * @param   dstSize - I - size of pDst
+ * @param   pDecodedSize - O - number of bytes written to pDst
+ *
+ * @return  0 = PASS, -1 = the stream is corrupt or doesn't fit in pDst
+ *
+ */
+{
+    uint32 S = 0, D = 0, n, bytes, pixel;
+    uint8 ctrl, color;
+    bool overrun = false;
+
+    if(SPLASH_SwapCopy == NULL)
+        SPLASH_CopyPixelsSwapped(pDst, pSrc, 0);
+#ifdef CODEC_SSE2
+    overrun = SPLASH_SwapCopy == SPLASH_SwapCopySSSE3;
+#endif
+
+    /* Runs and literals are written with wide stores that can spill past their end, as long as
+     * the spill stays inside pDst; the following data overwrites it. */
+    while(S + 1 < srcSize)
+    {
+        ctrl = pSrc[S];
+        color = pSrc[S + 1];
+        if(ctrl != 0)
+        {
+            /* Run of ctrl pixels */
+            bytes = ctrl * PIXEL_SIZE;
+            if(S + 1 + PIXEL_SIZE > srcSize || bytes > dstSize - D)
+                return -1;
+            pixel = pSrc[S + 1] | (pSrc[S + 3] << 8) | (pSrc[S + 2] << 16);
+            if(dstSize - D >= bytes + 48)
+            {
+                SPLASH_FillRunOverrun(pDst + D, pixel, ctrl);
+            }
+            else
+            {
+                for(n = 0; n < ctrl; n++)
+                    SPLASH_SwapCopyScalar(pDst + D + n * PIXEL_SIZE, pSrc + S + 1, 1);
+            }
+            D += bytes;
+            S += 1 + PIXEL_SIZE;
+        }
+        else if(color >= 2)
+        {
+            /* color literal pixels */
+            n = color;
+            bytes = n * PIXEL_SIZE;
+            if(bytes > srcSize - S - 2 || bytes > dstSize - D)
+                return -1;
+#ifdef CODEC_SSE2
+            if(overrun && srcSize - S - 2 >= bytes + 16 && dstSize - D >= bytes + 16)
+                SPLASH_SwapCopyOverrunSSSE3(pDst + D, pSrc + S + 2, n);
+            else
+#endif
+                SPLASH_SwapCopy(pDst + D, pSrc + S + 2, n);
+            D += bytes;
+            S += 2 + bytes;
+        }
+        else if(color == 0)
+        {
+            /* End of line, padded to 32 bits */
+            S = (S + 2 + 3) & ~3;
+        }
+        else
+        {
+            /* End of image */
+            break;
+        }
+    }
+
+    *pDecodedSize = D;
+    return 0;
+}
@@ -0,0 +1,21 @@
+/*
+ * splashcodec.h
+ *
+ * This module has the splash image compression kernels used when building firmware images.
+ *
+*/
+
+#ifndef SPLASHCODEC_H
+#define SPLASHCODEC_H
+
+#include "Common.h"
+
+uint32 SPLASH_RLECompress(const uint8 *pSrc, uint8 *pDst, uint32 width, uint32 height);
+uint32 SPLASH_RLEMaxSize(uint32 width, uint32 height);
+uint32 SPLASH_EstimateCompression(const uint8 *pSrc, uint32 width, uint32 height, uint32 stride,
+                                  uint32 maxPeriod, uint32 limit, uint32 *pPeriod);
+int SPLASH_RLEDecode(const uint8 *pSrc, uint32 srcSize, uint8 *pDst, uint32 dstSize, uint32 *pDecodedSize);
+void SPLASH_CopyPixelsSwapped(uint8 *pDst, const uint8 *pSrc, uint32 numPixels);
+uint32 SPLASH_FindPixelChange(const uint8 *pLine, uint32 start, uint32 width, bool equal);
+
+#endif
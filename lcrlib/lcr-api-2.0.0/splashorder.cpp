@@ -0,0 +1,208 @@
+/*
+ * splashorder.cpp
+ *
+ * This module reorders the images of an image-indexed pattern sequence to shorten the longest
+ * splash load on the critical path.
+ *
+ * In a sequence fed from flash, every image LUT entry owns the run of pattern LUT entries that starts
+ * with a buffer swap. While the patterns of one image are displayed, the next image is loaded, so the
+ * frame period must be at least (load time of the next image) / (number of patterns of the current one).
+ * The optimizer permutes the images, subject to the caller's block constraints, to minimize the worst
+ * such ratio, then rewrites the image LUT and moves the pattern LUT runs along with their images.
+ *
+*/
+
+#include "splashorder.h"
+#include "splashtiming.h"
+
+typedef struct
+{
+    uint32 Start;       /* first pattern LUT entry */
+    uint32 NumPats;     /* number of pattern LUT entries */
+    uint32 LoadTime;    /* microseconds */
+} SPLO_SEGMENT;
+
+static int SPLO_Segment(const LCR_SEQUENCE *pSeq, const unsigned int *pLoadTimes, SPLO_SEGMENT *pSegs)
+{
+    unsigned int i, numSegs = 0;
+
+    if(pSeq == NULL || pSeq->NumSplashLutEntries < 1 || pSeq->NumSplashLutEntries > SEQ_MAX_SPLASH_LUT_ENTRIES ||
+       pSeq->NumPatLutEntries < 1 || pSeq->NumPatLutEntries > SEQ_MAX_PAT_LUT_ENTRIES)
+        return -1;
+
+    for(i = 0; i < pSeq->NumPatLutEntries; i++)
+    {
+        if(i == 0 || (pSeq->PatLut[i] & BIT18))
+        {
+            if(numSegs == pSeq->NumSplashLutEntries)
+                return -1;
+            pSegs[numSegs].Start = i;
+            pSegs[numSegs].NumPats = 0;
+            numSegs++;
+        }
+        pSegs[numSegs - 1].NumPats++;
+    }
+
+    if(numSegs != pSeq->NumSplashLutEntries)
+        return -1;
+
+    for(i = 0; i < numSegs; i++)
+    {
+        if(pLoadTimes != NULL)
+            pSegs[i].LoadTime = pLoadTimes[pSeq->SplashLut[i]];
+        else if(LCR_GetSplashLoadTime(pSeq->SplashLut[i], &pSegs[i].LoadTime) < 0)
+            return -1;
+    }
+    return numSegs;
+}
+
+static void SPLO_Cost(const SPLO_SEGMENT *pSegs, const uint8 *pOrder, unsigned int numSegs, bool repeat,
+                      uint32 *pMax, uint32 *pSum)
+{
+    unsigned int k, next;
+    uint32 cost;
+
+    *pMax = 0;
+    *pSum = 0;
+    if(numSegs < 2)
+        return;
+
+    for(k = 0; k < numSegs; k++)
+    {
+        next = k + 1;
+        if(next == numSegs)
+        {
+            if(!repeat)
+                break;
+            next = 0;
+        }
+
+        cost = DIV_CEIL(pSegs[pOrder[next]].LoadTime, pSegs[pOrder[k]].NumPats);
+        *pMax = MAX(*pMax, cost);
+        *pSum += cost;
+    }
+}
+
+extern "C" int LCR_GetSplashLoadBottleneck(const LCR_SEQUENCE *pSeq, const unsigned int *pLoadTimes, unsigned int *pFramePeriod)
+/**
+ * This API does not send any commands to the controller.
+ * It computes the shortest frame period that leaves time to load every image of the sequence while
+ * the previous image is displayed.
+ *
+ * @param   pSeq - I - sequence with image LUT and pattern LUT (buffer swap marks the first pattern of each image)
+ * @param   pLoadTimes - I - load time in microseconds, indexed by image index. NULL = use LCR_GetSplashLoadTime().
+ * @param   pFramePeriod - O - frame period in microseconds
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    SPLO_SEGMENT segs[SEQ_MAX_SPLASH_LUT_ENTRIES];
+    uint8 order[SEQ_MAX_SPLASH_LUT_ENTRIES];
+    uint32 maxCost, sumCost;
+    int i, numSegs;
+
+    numSegs = SPLO_Segment(pSeq, pLoadTimes, segs);
+    if(numSegs < 0 || pFramePeriod == NULL)
+        return -1;
+
+    for(i = 0; i < numSegs; i++)
+        order[i] = i;
+
+    SPLO_Cost(segs, order, numSegs, pSeq->Repeat != 0, &maxCost, &sumCost);
+    *pFramePeriod = maxCost;
+    return 0;
+}
+
+extern "C" int LCR_OptimizeSplashOrder(LCR_SEQUENCE *pSeq, const unsigned char *pBlocks, const unsigned int *pLoadTimes, unsigned char *pOrder, unsigned int *pFramePeriod)
+/**
+ * This API does not send any commands to the controller.
+ * It reorders the image LUT of the sequence to minimize the frame period needed to load each image
+ * while the previous one is displayed (see LCR_GetSplashLoadBottleneck()). The pattern LUT entries of
+ * each image move with it. Ties on the worst load are broken by the total over all images.
+ * The search swaps pairs of images until no swap improves the order, starting from the current order.
+ *
+ * @param   pSeq - I/O - sequence to be reordered
+ * @param   pBlocks - I - block number of each image LUT entry. Entries only trade places with entries of the
+ *                        same block, so every block keeps its positions. NULL = all entries may move.
+ * @param   pLoadTimes - I - load time in microseconds, indexed by image index. NULL = use LCR_GetSplashLoadTime().
+ * @param   pOrder - O - original image LUT position of each new position. May be NULL.
+ * @param   pFramePeriod - O - shortest frame period for the new order in microseconds. May be NULL.
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    SPLO_SEGMENT segs[SEQ_MAX_SPLASH_LUT_ENTRIES];
+    uint8 order[SEQ_MAX_SPLASH_LUT_ENTRIES];
+    uint8 splashLut[SEQ_MAX_SPLASH_LUT_ENTRIES];
+    uint32 patLut[SEQ_MAX_PAT_LUT_ENTRIES];
+    uint32 bestMax, bestSum, maxCost, sumCost, lutWord;
+    unsigned int i, j, k, numEntries;
+    bool repeat, improved;
+    int numSegs;
+    uint8 tmp;
+
+    numSegs = SPLO_Segment(pSeq, pLoadTimes, segs);
+    if(numSegs < 0)
+        return -1;
+
+    repeat = (pSeq->Repeat != 0);
+    for(i = 0; i < (unsigned int)numSegs; i++)
+        order[i] = i;
+    SPLO_Cost(segs, order, numSegs, repeat, &bestMax, &bestSum);
+
+    do
+    {
+        improved = false;
+        for(i = 0; i < (unsigned int)numSegs; i++)
+        {
+            for(j = i + 1; j < (unsigned int)numSegs; j++)
+            {
+                if(pBlocks != NULL && pBlocks[i] != pBlocks[j])
+                    continue;
+
+                tmp = order[i]; order[i] = order[j]; order[j] = tmp;
+                SPLO_Cost(segs, order, numSegs, repeat, &maxCost, &sumCost);
+                if(maxCost < bestMax || (maxCost == bestMax && sumCost < bestSum))
+                {
+                    bestMax = maxCost;
+                    bestSum = sumCost;
+                    improved = true;
+                }
+                else
+                {
+                    tmp = order[i]; order[i] = order[j]; order[j] = tmp;
+                }
+            }
+        }
+    } while(improved);
+
+    /* Rebuild the LUTs. The first entry keeps its buffer swap setting; every other image starts with a swap. */
+    numEntries = 0;
+    for(k = 0; k < (unsigned int)numSegs; k++)
+    {
+        splashLut[k] = pSeq->SplashLut[order[k]];
+        for(i = 0; i < segs[order[k]].NumPats; i++)
+        {
+            lutWord = pSeq->PatLut[segs[order[k]].Start + i];
+            if(i == 0)
+            {
+                lutWord &= ~BIT18;
+                lutWord |= (k == 0) ? (pSeq->PatLut[0] & BIT18) : BIT18;
+            }
+            patLut[numEntries++] = lutWord;
+        }
+    }
+
+    memcpy(pSeq->PatLut, patLut, numEntries * sizeof(uint32));
+    memcpy(pSeq->SplashLut, splashLut, numSegs);
+
+    if(pOrder != NULL)
+        memcpy(pOrder, order, numSegs);
+    if(pFramePeriod != NULL)
+        *pFramePeriod = bestMax;
+    return 0;
+}
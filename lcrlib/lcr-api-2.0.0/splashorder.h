@@ -0,0 +1,19 @@
+/*
+ * splashorder.h
+ *
+ * This module reorders the images of an image-indexed pattern sequence to shorten the longest
+ * splash load on the critical path.
+ *
+*/
+
+#ifndef SPLASHORDER_H
+#define SPLASHORDER_H
+
+#include "Common.h"
+#include "API.h"
+#include "sequence.h"
+
+extern "C" int API_API_EXPORT LCR_GetSplashLoadBottleneck(const LCR_SEQUENCE *pSeq, const unsigned int *pLoadTimes, unsigned int *pFramePeriod);
+extern "C" int API_API_EXPORT LCR_OptimizeSplashOrder(LCR_SEQUENCE *pSeq, const unsigned char *pBlocks, const unsigned int *pLoadTimes, unsigned char *pOrder, unsigned int *pFramePeriod);
+
+#endif // SPLASHORDER_H
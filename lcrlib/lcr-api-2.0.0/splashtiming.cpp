@@ -0,0 +1,298 @@
+/*
+ * splashtiming.cpp
+ *
+ * This module measures the load time of every splash image in flash and keeps the results in a
+ * database file, one record per firmware image.
+ *
+ * The database is keyed by a checksum of the firmware, so a sweep is only needed after the flash
+ * content changes. The record of the firmware in use is kept in memory for the lookup APIs.
+ *
+*/
+
+#include "splashtiming.h"
+#include "checksum.h"
+#include "filemap.h"
+#include <stdio.h>
+
+static SPLT_RECORD Current;
+static bool CurrentValid = false;
+
+static int SPLT_ReadDb(const char *path, SPLT_RECORD *pRecords)
+{
+    SPLT_DB_HEADER header;
+    unsigned int numRecords;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if(fp == NULL)
+        return 0;
+
+    if(fread(&header, sizeof(header), 1, fp) != 1 || header.Signature != SPLT_DB_SIGNATURE ||
+       header.Version != SPLT_DB_VERSION || header.NumRecords > SPLT_MAX_RECORDS)
+    {
+        fclose(fp);
+        return 0;
+    }
+
+    numRecords = header.NumRecords;
+    if(fread(pRecords, sizeof(SPLT_RECORD), numRecords, fp) != numRecords ||
+       CHKSUM_Crc32((const uint8 *)pRecords, numRecords * sizeof(SPLT_RECORD)) != header.Checksum)
+        numRecords = 0;
+
+    fclose(fp);
+    return numRecords;
+}
+
+static int SPLT_WriteDb(const char *path, const SPLT_RECORD *pRecords, unsigned int numRecords)
+{
+    SPLT_DB_HEADER header;
+    char tempPath[1024];
+    FILE *fp;
+
+    header.Signature = SPLT_DB_SIGNATURE;
+    header.Version = SPLT_DB_VERSION;
+    header.NumRecords = numRecords;
+    header.Checksum = CHKSUM_Crc32((const uint8 *)pRecords, numRecords * sizeof(SPLT_RECORD));
+
+    if(snprintf(tempPath, sizeof(tempPath), "%s.tmp", path) >= (int)sizeof(tempPath))
+        return -1;
+
+    fp = fopen(tempPath, "wb");
+    if(fp == NULL)
+        return -1;
+
+    if(fwrite(&header, sizeof(header), 1, fp) != 1 ||
+       fwrite(pRecords, sizeof(SPLT_RECORD), numRecords, fp) != numRecords)
+    {
+        fclose(fp);
+        remove(tempPath);
+        return -1;
+    }
+
+    if(fclose(fp) != 0)
+    {
+        remove(tempPath);
+        return -1;
+    }
+
+#ifdef _WIN32
+    remove(path);
+#endif
+    if(rename(tempPath, path) != 0)
+    {
+        remove(tempPath);
+        return -1;
+    }
+    return 0;
+}
+
+static int SPLT_Find(const SPLT_RECORD *pRecords, unsigned int numRecords, uint32 firmwareChecksum)
+{
+    unsigned int i;
+
+    for(i = 0; i < numRecords; i++)
+    {
+        if(pRecords[i].FirmwareChecksum == firmwareChecksum)
+            return i;
+    }
+    return -1;
+}
+
+extern "C" int LCR_SplashTimingFileChecksum(const char *firmwarePath, unsigned int *pChecksum)
+/**
+ * This API does not send any commands to the controller.
+ * It computes the CRC-32 of a firmware image file, to be used as the database key of the firmware
+ * that was programmed from it.
+ *
+ * @param   firmwarePath - I - firmware image file
+ * @param   pChecksum - O - checksum of the file
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    FILEMAP map;
+
+    if(pChecksum == NULL || FILEMAP_Open(&map, firmwarePath) < 0)
+        return -1;
+
+    *pChecksum = CHKSUM_Crc32(map.Data, map.Size);
+    FILEMAP_Close(&map);
+    return 0;
+}
+
+extern "C" int LCR_SplashTimingProfile(const char *dbPath, unsigned int firmwareChecksum, unsigned int numImages, bool force)
+/**
+ * This API measures the load time of every splash image with LCR_MeasureSplashLoadTiming() and
+ * LCR_ReadSplashLoadTiming() and stores the results in the database under the firmware checksum.
+ * If the database already holds a record for the checksum, it is used without measuring unless force is set.
+ * The database keeps the SPLT_MAX_RECORDS most recently profiled firmwares.
+ * Stop the pattern sequence before calling this API.
+ *
+ * @param   dbPath - I - database file, created if missing
+ * @param   firmwareChecksum - I - checksum identifying the flash content, e.g. from LCR_SplashTimingFileChecksum()
+ * @param   numImages - I - number of images in flash. 0 = measure until the controller rejects an index
+ *                           (NACK); any other error fails the profile and nothing is stored.
+ * @param   force - I - measure even if the database has a record for the firmware
+ *
+ * @return  >=0 = number of images in the record    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    SPLT_RECORD *pRecords;
+    unsigned int i, loadTime, maxImages;
+    int numRecords, found, ret;
+
+    if(dbPath == NULL || numImages > SPLT_MAX_IMAGES)
+        return -1;
+
+    pRecords = (SPLT_RECORD *)malloc(SPLT_MAX_RECORDS * sizeof(SPLT_RECORD));
+    if(pRecords == NULL)
+        return -1;
+
+    numRecords = SPLT_ReadDb(dbPath, pRecords);
+    found = SPLT_Find(pRecords, numRecords, firmwareChecksum);
+    if(found >= 0 && !force)
+    {
+        Current = pRecords[found];
+        CurrentValid = true;
+        free(pRecords);
+        return Current.NumImages;
+    }
+
+    CurrentValid = false;
+    memset(&Current, 0, sizeof(Current));
+    Current.FirmwareChecksum = firmwareChecksum;
+
+    maxImages = numImages ? numImages : SPLT_MAX_IMAGES;
+    for(i = 0; i < maxImages; i++)
+    {
+        ret = LCR_MeasureSplashLoadTiming(i, 1) < 0 ? -1 : LCR_ReadSplashLoadTiming(&loadTime);
+        if(ret < 0)
+        {
+            /* Only a rejected index ends the list, a record cut short by a USB error would be reused */
+            if(ret == -2 && numImages == 0 && i > 0)
+                break;
+            free(pRecords);
+            return -1;
+        }
+        Current.LoadTime[i] = loadTime;
+    }
+    Current.NumImages = i;
+
+    if(found < 0)
+    {
+        if(numRecords == SPLT_MAX_RECORDS)
+        {
+            /* Drop the oldest record */
+            memmove(&pRecords[0], &pRecords[1], (SPLT_MAX_RECORDS - 1) * sizeof(SPLT_RECORD));
+            numRecords--;
+        }
+        found = numRecords++;
+    }
+    pRecords[found] = Current;
+
+    if(SPLT_WriteDb(dbPath, pRecords, numRecords) < 0)
+    {
+        free(pRecords);
+        return -1;
+    }
+
+    free(pRecords);
+    CurrentValid = true;
+    return Current.NumImages;
+}
+
+extern "C" int LCR_SplashTimingLoad(const char *dbPath, unsigned int firmwareChecksum)
+/**
+ * This API does not send any commands to the controller.
+ * It selects the record of the given firmware from the database for the lookup APIs.
+ *
+ * @return  >=0 = number of images in the record    <BR>
+ *          -1 = FAIL (no record for the firmware)  <BR>
+ *
+ */
+{
+    SPLT_RECORD *pRecords;
+    int numRecords, found;
+
+    if(dbPath == NULL)
+        return -1;
+
+    pRecords = (SPLT_RECORD *)malloc(SPLT_MAX_RECORDS * sizeof(SPLT_RECORD));
+    if(pRecords == NULL)
+        return -1;
+
+    numRecords = SPLT_ReadDb(dbPath, pRecords);
+    found = SPLT_Find(pRecords, numRecords, firmwareChecksum);
+    if(found >= 0)
+    {
+        Current = pRecords[found];
+        CurrentValid = true;
+    }
+
+    free(pRecords);
+    return found >= 0 ? (int)Current.NumImages : -1;
+}
+
+extern "C" int LCR_SplashTimingCount(void)
+/**
+ * @return  number of images in the selected record <BR>
+ *          -1 = FAIL (no record selected)  <BR>
+ *
+ */
+{
+    return CurrentValid ? (int)Current.NumImages : -1;
+}
+
+extern "C" int LCR_GetSplashLoadTime(unsigned int index, unsigned int *pLoadTime)
+/**
+ * This API does not send any commands to the controller.
+ * It looks up the load time of an image in the record selected by LCR_SplashTimingProfile() or LCR_SplashTimingLoad().
+ *
+ * @param   index - I - image index
+ * @param   pLoadTime - O - load time in microseconds
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    if(!CurrentValid || pLoadTime == NULL || index >= Current.NumImages)
+        return -1;
+
+    *pLoadTime = (unsigned int)DIV_ROUND((unsigned long long)Current.LoadTime[index] * 1000, SPLT_TICKS_PER_MS);
+    return 0;
+}
+
+extern "C" int LCR_GetMaxSplashLoadTime(const unsigned char *pIndices, unsigned int numIndices, unsigned int *pLoadTime)
+/**
+ * This API does not send any commands to the controller.
+ * It looks up the longest load time among the given images, e.g. the entries of an image LUT.
+ *
+ * @param   pIndices - I - image indices
+ * @param   numIndices - I - number of indices
+ * @param   pLoadTime - O - load time in microseconds
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    unsigned int i, loadTime, maxTime = 0;
+
+    if(pIndices == NULL || pLoadTime == NULL)
+        return -1;
+
+    for(i = 0; i < numIndices; i++)
+    {
+        if(LCR_GetSplashLoadTime(pIndices[i], &loadTime) < 0)
+            return -1;
+        maxTime = MAX(maxTime, loadTime);
+    }
+
+    *pLoadTime = maxTime;
+    return 0;
+}
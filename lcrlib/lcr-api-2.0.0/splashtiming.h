@@ -0,0 +1,44 @@
+/*
+ * splashtiming.h
+ *
+ * This module measures the load time of every splash image in flash and keeps the results in a
+ * database file, one record per firmware image.
+ *
+*/
+
+#ifndef SPLASHTIMING_H
+#define SPLASHTIMING_H
+
+#include "Common.h"
+#include "API.h"
+
+#define SPLT_MAX_IMAGES         256
+#define SPLT_MAX_RECORDS        16
+#define SPLT_TICKS_PER_MS       18667   /* LCR_ReadSplashLoadTiming() units */
+
+#define SPLT_DB_SIGNATURE       0x54504C53  /* "SLPT" */
+#define SPLT_DB_VERSION         1
+
+typedef struct
+{
+    uint32  Signature;      /* SPLT_DB_SIGNATURE */
+    uint16  Version;        /* SPLT_DB_VERSION */
+    uint16  NumRecords;
+    uint32  Checksum;       /* CRC-32 of all the records following the header */
+} SPLT_DB_HEADER;
+
+typedef struct
+{
+    uint32  FirmwareChecksum;
+    uint32  NumImages;
+    uint32  LoadTime[SPLT_MAX_IMAGES];  /* raw LCR_ReadSplashLoadTiming() values */
+} SPLT_RECORD;
+
+extern "C" int API_API_EXPORT LCR_SplashTimingFileChecksum(const char *firmwarePath, unsigned int *pChecksum);
+extern "C" int API_API_EXPORT LCR_SplashTimingProfile(const char *dbPath, unsigned int firmwareChecksum, unsigned int numImages, bool force);
+extern "C" int API_API_EXPORT LCR_SplashTimingLoad(const char *dbPath, unsigned int firmwareChecksum);
+extern "C" int API_API_EXPORT LCR_SplashTimingCount(void);
+extern "C" int API_API_EXPORT LCR_GetSplashLoadTime(unsigned int index, unsigned int *pLoadTime);
+extern "C" int API_API_EXPORT LCR_GetMaxSplashLoadTime(const unsigned char *pIndices, unsigned int numIndices, unsigned int *pLoadTime);
+
+#endif // SPLASHTIMING_H
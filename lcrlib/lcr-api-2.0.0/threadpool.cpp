@@ -0,0 +1,256 @@
+/*
+ * threadpool.cpp
+ *
+ * This module runs independent work items on a pool of worker threads on Linux and Windows.
+ *
+ * Workers take the next item index from a shared counter until all items are done, so items of
+ * uneven cost are balanced across the threads. The calling thread works as one of the workers.
+ *
+ * Single background threads are used for producer/consumer pipelines; the two sides exchange
+ * ring buffer indices with the atomics below and poll with THREAD_Sleep() while waiting.
+ *
+*/
+
+#include "threadpool.h"
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define THREAD_MAX_WORKERS      64
+
+typedef struct
+{
+    THREAD_TASK Task;
+    void *pContext;
+    unsigned int Count;
+    volatile long Next;
+} THREAD_JOB;
+
+typedef struct
+{
+    THREAD_TASK Task;
+    void *pContext;
+#ifdef _WIN32
+    HANDLE Thread;
+#else
+    pthread_t Thread;
+#endif
+} THREAD_SINGLE;
+
+long THREAD_AtomicLoad(volatile long *pValue)
+/**
+ * @return  value read with a full memory barrier
+ *
+ */
+{
+#ifdef _WIN32
+    return InterlockedCompareExchange(pValue, 0, 0);
+#else
+    return __sync_fetch_and_add(pValue, 0);
+#endif
+}
+
+long THREAD_AtomicIncrement(volatile long *pValue)
+/**
+ * Increments the value with a full memory barrier.
+ *
+ * @return  incremented value
+ *
+ */
+{
+#ifdef _WIN32
+    return InterlockedIncrement(pValue);
+#else
+    return __sync_add_and_fetch(pValue, 1);
+#endif
+}
+
+static unsigned int THREAD_NextIndex(THREAD_JOB *pJob)
+{
+    return (unsigned int)(THREAD_AtomicIncrement(&pJob->Next) - 1);
+}
+
+static void THREAD_Work(THREAD_JOB *pJob)
+{
+    unsigned int index;
+
+    for(index = THREAD_NextIndex(pJob); index < pJob->Count; index = THREAD_NextIndex(pJob))
+        pJob->Task(pJob->pContext, index);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI THREAD_Entry(LPVOID pArg)
+{
+    THREAD_Work((THREAD_JOB *)pArg);
+    return 0;
+}
+
+static DWORD WINAPI THREAD_SingleEntry(LPVOID pArg)
+{
+    THREAD_SINGLE *pSingle = (THREAD_SINGLE *)pArg;
+
+    pSingle->Task(pSingle->pContext, 0);
+    return 0;
+}
+#else
+static void *THREAD_Entry(void *pArg)
+{
+    THREAD_Work((THREAD_JOB *)pArg);
+    return NULL;
+}
+
+static void *THREAD_SingleEntry(void *pArg)
+{
+    THREAD_SINGLE *pSingle = (THREAD_SINGLE *)pArg;
+
+    pSingle->Task(pSingle->pContext, 0);
+    return NULL;
+}
+#endif
+
+unsigned int THREAD_GetNumCores(void)
+/**
+ * @return  number of processors available to the process, at least 1
+ *
+ */
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return MAX(info.dwNumberOfProcessors, 1);
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (unsigned int)n : 1;
+#endif
+}
+
+int THREAD_ParallelFor(unsigned int count, THREAD_TASK task, void *pContext, unsigned int numThreads)
+/**
+ * Calls task(pContext, index) once for every index in 0..count-1 and returns when all calls are done.
+ * The calls run concurrently and in no particular order.
+ *
+ * @param   count - I - number of work items
+ * @param   task - I - function processing one item
+ * @param   pContext - I - passed to every call
+ * @param   numThreads - I - number of threads including the caller. 0 = one per processor.
+ *
+ * @return  number of threads used
+ *
+ */
+{
+    THREAD_JOB job;
+    unsigned int i, numWorkers = 0;
+#ifdef _WIN32
+    HANDLE threads[THREAD_MAX_WORKERS];
+#else
+    pthread_t threads[THREAD_MAX_WORKERS];
+#endif
+
+    job.Task = task;
+    job.pContext = pContext;
+    job.Count = count;
+    job.Next = 0;
+
+    if(numThreads == 0)
+        numThreads = THREAD_GetNumCores();
+    numThreads = MIN(numThreads, MIN(count, THREAD_MAX_WORKERS + 1));
+
+    /* If a thread can't be created the remaining workers simply take more items */
+    for(i = 1; i < numThreads; i++)
+    {
+#ifdef _WIN32
+        threads[numWorkers] = CreateThread(NULL, 0, THREAD_Entry, &job, 0, NULL);
+        if(threads[numWorkers] == NULL)
+            break;
+#else
+        if(pthread_create(&threads[numWorkers], NULL, THREAD_Entry, &job) != 0)
+            break;
+#endif
+        numWorkers++;
+    }
+
+    THREAD_Work(&job);
+
+    for(i = 0; i < numWorkers; i++)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+    return numWorkers + 1;
+}
+
+int THREAD_Start(THREAD_HANDLE *pThread, THREAD_TASK task, void *pContext)
+/**
+ * Starts a thread calling task(pContext, 0). THREAD_Join() must be called on every started thread.
+ *
+ * @param   pThread - O - handle of the thread
+ * @param   task - I - function run by the thread
+ * @param   pContext - I - passed to the task
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL, the thread couldn't be created <BR>
+ *
+ */
+{
+    THREAD_SINGLE *pSingle;
+
+    pSingle = (THREAD_SINGLE *)malloc(sizeof(THREAD_SINGLE));
+    if(pSingle == NULL)
+        return -1;
+
+    pSingle->Task = task;
+    pSingle->pContext = pContext;
+#ifdef _WIN32
+    pSingle->Thread = CreateThread(NULL, 0, THREAD_SingleEntry, pSingle, 0, NULL);
+    if(pSingle->Thread == NULL)
+#else
+    if(pthread_create(&pSingle->Thread, NULL, THREAD_SingleEntry, pSingle) != 0)
+#endif
+    {
+        free(pSingle);
+        return -1;
+    }
+
+    *pThread = pSingle;
+    return 0;
+}
+
+void THREAD_Join(THREAD_HANDLE thread)
+/**
+ * Waits for a thread started with THREAD_Start() to return and releases it.
+ *
+ */
+{
+    THREAD_SINGLE *pSingle = (THREAD_SINGLE *)thread;
+
+#ifdef _WIN32
+    WaitForSingleObject(pSingle->Thread, INFINITE);
+    CloseHandle(pSingle->Thread);
+#else
+    pthread_join(pSingle->Thread, NULL);
+#endif
+    free(pSingle);
+}
+
+void THREAD_Sleep(unsigned int microseconds)
+/**
+ * Suspends the calling thread for about the given time, rounded up to milliseconds on Windows.
+ *
+ */
+{
+#ifdef _WIN32
+    Sleep(MAX(microseconds / 1000, 1));
+#else
+    usleep(microseconds);
+#endif
+}
@@ -0,0 +1,25 @@
+/*
+ * threadpool.h
+ *
+ * This module runs independent work items on a pool of worker threads on Linux and Windows.
+ * It also starts single background threads and provides the atomics to hand data to them.
+ *
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "Common.h"
+
+typedef void (*THREAD_TASK)(void *pContext, unsigned int index);
+typedef void *THREAD_HANDLE;
+
+unsigned int THREAD_GetNumCores(void);
+int THREAD_ParallelFor(unsigned int count, THREAD_TASK task, void *pContext, unsigned int numThreads);
+int THREAD_Start(THREAD_HANDLE *pThread, THREAD_TASK task, void *pContext);
+void THREAD_Join(THREAD_HANDLE thread);
+void THREAD_Sleep(unsigned int microseconds);
+long THREAD_AtomicLoad(volatile long *pValue);
+long THREAD_AtomicIncrement(volatile long *pValue);
+
+#endif
@@ -0,0 +1,298 @@
+/*
+ * tuner.cpp
+ *
+ * This module finds the shortest exposure and frame period accepted by the controller for a pattern sequence.
+ *
+ * A bound is computed from the pattern LUT (minimum exposure per bit depth, patterns sharing one
+ * trigger out exposure, black-fill time). The bound is then checked on the controller with the validation
+ * command. If it is accepted, the exposure is bisected down towards the minimum of the deepest pattern;
+ * if it is rejected, the exposure is raised until accepted and the smallest accepted value is located
+ * by bisection. The black-fill gap is then bisected the same way. Results are cached per sequence.
+ *
+*/
+
+#include "tuner.h"
+#include "checksum.h"
+
+#define TUNE_PERIOD_INVALID     (BIT0 | BIT4)   /* LCR_ValidatePatLutData() bits affected by the periods */
+
+typedef struct
+{
+    uint32 Hash;
+    uint32 NumPatLutEntries;
+    uint32 Exposure;
+    uint32 FramePeriod;
+} TUNE_CACHE_ENTRY;
+
+/* Minimum pattern exposure in microseconds, indexed by bit depth (DLPC350 programmer's guide) */
+static const unsigned int MinExposure[9] = { 0, 235, 700, 1570, 1700, 2000, 2500, 4500, 8333 };
+
+static TUNE_CACHE_ENTRY TuneCache[TUNE_CACHE_SIZE];
+static unsigned int TuneCacheCount;
+static unsigned int TuneCacheNext;
+
+/* Hashes every field LCR_SendSequence() programs, except the periods being tuned */
+static uint32 TUNE_Hash(const LCR_SEQUENCE *pSeq)
+{
+    LCR_SEQUENCE seq;
+
+    seq = *pSeq;
+    memset(seq.Name, 0, sizeof(seq.Name));
+    memset(&seq.PatLut[seq.NumPatLutEntries], 0, (SEQ_MAX_PAT_LUT_ENTRIES - seq.NumPatLutEntries) * sizeof(uint32));
+    if(seq.NumSplashLutEntries < SEQ_MAX_SPLASH_LUT_ENTRIES)
+        memset(&seq.SplashLut[seq.NumSplashLutEntries], 0, SEQ_MAX_SPLASH_LUT_ENTRIES - seq.NumSplashLutEntries);
+    seq.ExposurePeriod = 0;
+    seq.FramePeriod = 0;
+    memset(seq.Reserved, 0, sizeof(seq.Reserved));
+
+    return CHKSUM_Crc32((const uint8 *)&seq, sizeof(seq));
+}
+
+static TUNE_CACHE_ENTRY *TUNE_CacheLookup(uint32 hash, uint32 numEntries)
+{
+    unsigned int i;
+
+    for(i = 0; i < TuneCacheCount; i++)
+    {
+        if(TuneCache[i].Hash == hash && TuneCache[i].NumPatLutEntries == numEntries)
+            return &TuneCache[i];
+    }
+    return NULL;
+}
+
+static void TUNE_CacheStore(uint32 hash, uint32 numEntries, uint32 exposure, uint32 framePeriod)
+{
+    TUNE_CACHE_ENTRY *pEntry;
+
+    pEntry = TUNE_CacheLookup(hash, numEntries);
+    if(pEntry == NULL)
+    {
+        pEntry = &TuneCache[TuneCacheNext];
+        TuneCacheNext = (TuneCacheNext + 1) % TUNE_CACHE_SIZE;
+        if(TuneCacheCount < TUNE_CACHE_SIZE)
+            TuneCacheCount++;
+    }
+
+    pEntry->Hash = hash;
+    pEntry->NumPatLutEntries = numEntries;
+    pEntry->Exposure = exposure;
+    pEntry->FramePeriod = framePeriod;
+}
+
+/* Programs the periods and returns 1 if accepted, 0 if rejected, -1 on communication failure */
+static int TUNE_Try(unsigned int exposure, unsigned int gap)
+{
+    unsigned int status;
+
+    if(LCR_SetExposure_FramePeriod(exposure, exposure + gap) < 0)
+        return -1;
+
+    if(LCR_ValidatePatLutData(&status) < 0)
+        return -1;
+
+    return (status & TUNE_PERIOD_INVALID) ? 0 : 1;
+}
+
+/* Finds the smallest accepted exposure (or gap if searchGap) in (lo, hi], lo being rejected and hi accepted */
+static int TUNE_Bisect(unsigned int lo, unsigned int hi, unsigned int exposure, unsigned int gap, bool searchGap, unsigned int *pResult)
+{
+    unsigned int mid;
+    int ret;
+
+    while(hi - lo > 1)
+    {
+        mid = lo + (hi - lo) / 2;
+        ret = searchGap ? TUNE_Try(exposure, mid) : TUNE_Try(mid, gap);
+        if(ret < 0)
+            return -1;
+        if(ret)
+            hi = mid;
+        else
+            lo = mid;
+    }
+
+    *pResult = hi;
+    return 0;
+}
+
+/* Smallest exposure the controller could accept, that of the deepest pattern alone */
+static unsigned int TUNE_HardwareMin(const LCR_SEQUENCE *pSeq)
+{
+    unsigned int i, exposure = 0;
+
+    for(i = 0; i < pSeq->NumPatLutEntries; i++)
+        exposure = MAX(exposure, MinExposure[(pSeq->PatLut[i] >> 8) & 0xF]);
+    return exposure;
+}
+
+extern "C" int LCR_GetMinExposure_FramePeriod(const LCR_SEQUENCE *pSeq, unsigned int *pExposure, unsigned int *pFramePeriod)
+/**
+ * This API does not send any commands to the controller.
+ * It computes the lower bound of the exposure and frame period for the pattern LUT of the sequence.
+ * Patterns chained with trigOutPrev share one exposure, so their minimum exposures add up.
+ * If any pattern inserts black-fill, the frame period exceeds the exposure by TUNE_BLACK_FILL_TIME.
+ *
+ * @param   pSeq - I - sequence with the pattern LUT
+ * @param   pExposure - O - minimum exposure in microseconds
+ * @param   pFramePeriod - O - minimum frame period in microseconds
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *
+ */
+{
+    unsigned int i, bitDepth, groupExposure = 0, exposure = 0;
+    bool insertBlack = false;
+
+    if(pSeq == NULL || pSeq->NumPatLutEntries < 1 || pSeq->NumPatLutEntries > SEQ_MAX_PAT_LUT_ENTRIES)
+        return -1;
+
+    for(i = 0; i < pSeq->NumPatLutEntries; i++)
+    {
+        bitDepth = (pSeq->PatLut[i] >> 8) & 0xF;
+        if(bitDepth < 1 || bitDepth > 8)
+            return -1;
+
+        if(!(pSeq->PatLut[i] & BIT19))
+            groupExposure = 0;
+        groupExposure += MinExposure[bitDepth];
+        exposure = MAX(exposure, groupExposure);
+
+        if(pSeq->PatLut[i] & BIT17)
+            insertBlack = true;
+    }
+
+    if(pExposure != NULL)
+        *pExposure = exposure;
+    if(pFramePeriod != NULL)
+        *pFramePeriod = insertBlack ? exposure + TUNE_BLACK_FILL_TIME : exposure;
+    return 0;
+}
+
+extern "C" int LCR_TuneExposure_FramePeriod(LCR_SEQUENCE *pSeq, unsigned int *pExposure, unsigned int *pFramePeriod)
+/**
+ * This API programs the sequence into the controller and finds the shortest exposure and frame period that
+ * pass LCR_ValidatePatLutData() (BIT0 and BIT4 clear). The search starts from the bound given by
+ * LCR_GetMinExposure_FramePeriod(). An accepted bound is bisected down to the minimum exposure of the
+ * deepest pattern; a rejected one is raised with a doubling step until accepted and then bisected.
+ * The black-fill gap between the exposure and the frame period is bisected down to 0 the same way,
+ * to 1 microsecond. The result is stored in the sequence, left programmed in the controller and cached,
+ * so tuning the same sequence again only programs the cached values.
+ * The pattern sequence is stopped by this API.
+ *
+ * @param   pSeq - I/O - sequence to be tuned. ExposurePeriod and FramePeriod are updated.
+ * @param   pExposure - O - exposure in microseconds. May be NULL.
+ * @param   pFramePeriod - O - frame period in microseconds. May be NULL.
+ *
+ * @return  0 = PASS    <BR>
+ *          -1 = FAIL  <BR>
+ *          -2 = no valid setting up to TUNE_MAX_PERIOD <BR>
+ *
+ */
+{
+    TUNE_CACHE_ENTRY *pCached;
+    unsigned int exposure, framePeriod, gap, lo, hi, step, status;
+    uint32 hash;
+    int ret;
+
+    if(LCR_GetMinExposure_FramePeriod(pSeq, &exposure, &framePeriod) < 0)
+        return -1;
+
+    hash = TUNE_Hash(pSeq);
+    pCached = TUNE_CacheLookup(hash, pSeq->NumPatLutEntries);
+    if(pCached != NULL)
+    {
+        exposure = pCached->Exposure;
+        framePeriod = pCached->FramePeriod;
+    }
+
+    pSeq->ExposurePeriod = exposure;
+    pSeq->FramePeriod = framePeriod;
+    if(LCR_SendSequence(pSeq, &status) < 0)
+        return -1;
+
+    if(status & BIT1)
+        return -1;
+
+    /* Cached values were searched already */
+    if(pCached != NULL && !(status & TUNE_PERIOD_INVALID))
+        goto done;
+
+    gap = framePeriod - exposure;
+    if(!(status & TUNE_PERIOD_INVALID))
+    {
+        /* The bound is conservative, look for a shorter exposure down to the hardware minimum */
+        hi = exposure;
+        lo = TUNE_HardwareMin(pSeq);
+        if(lo < hi)
+        {
+            ret = TUNE_Try(lo, gap);
+            if(ret < 0)
+                return -1;
+            if(ret)
+                hi = lo;
+            else if(TUNE_Bisect(lo, hi, 0, gap, false, &hi) < 0)
+                return -1;
+        }
+    }
+    else
+    {
+        hi = exposure;
+        step = MAX(exposure / 16, 1);
+        for(;;)
+        {
+            if(hi >= TUNE_MAX_PERIOD)
+                return -2;
+            lo = hi;
+            hi = MIN(hi + step, TUNE_MAX_PERIOD);
+            step *= 2;
+
+            ret = TUNE_Try(hi, gap);
+            if(ret < 0)
+                return -1;
+            if(ret)
+                break;
+        }
+
+        if(TUNE_Bisect(lo, hi, 0, gap, false, &hi) < 0)
+            return -1;
+    }
+    exposure = hi;
+
+    /* The black-fill time is a bound as well */
+    if(gap > 0)
+    {
+        ret = TUNE_Try(exposure, 0);
+        if(ret < 0)
+            return -1;
+        if(ret)
+            gap = 0;
+        else if(TUNE_Bisect(0, gap, exposure, 0, true, &gap) < 0)
+            return -1;
+    }
+
+    framePeriod = exposure + gap;
+    if(TUNE_Try(exposure, gap) != 1)
+        return -1;
+
+    pSeq->ExposurePeriod = exposure;
+    pSeq->FramePeriod = framePeriod;
+
+done:
+    TUNE_CacheStore(hash, pSeq->NumPatLutEntries, exposure, framePeriod);
+    if(pExposure != NULL)
+        *pExposure = exposure;
+    if(pFramePeriod != NULL)
+        *pFramePeriod = framePeriod;
+    return 0;
+}
+
+extern "C" void LCR_TuneClearCache(void)
+/**
+ * Forgets all results cached by LCR_TuneExposure_FramePeriod(), e.g. after a firmware update.
+ *
+ */
+{
+    TuneCacheCount = 0;
+    TuneCacheNext = 0;
+}
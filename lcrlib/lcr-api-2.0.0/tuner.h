@@ -0,0 +1,23 @@
+/*
+ * tuner.h
+ *
+ * This module finds the shortest exposure and frame period accepted by the controller for a pattern sequence.
+ *
+*/
+
+#ifndef TUNER_H
+#define TUNER_H
+
+#include "Common.h"
+#include "API.h"
+#include "sequence.h"
+
+#define TUNE_BLACK_FILL_TIME        230         /* microseconds needed by an inserted black-fill pattern */
+#define TUNE_MAX_PERIOD             10000000    /* upper limit of the search, microseconds */
+#define TUNE_CACHE_SIZE             32
+
+extern "C" int API_API_EXPORT LCR_GetMinExposure_FramePeriod(const LCR_SEQUENCE *pSeq, unsigned int *pExposure, unsigned int *pFramePeriod);
+extern "C" int API_API_EXPORT LCR_TuneExposure_FramePeriod(LCR_SEQUENCE *pSeq, unsigned int *pExposure, unsigned int *pFramePeriod);
+extern "C" void API_API_EXPORT LCR_TuneClearCache(void);
+
+#endif // TUNER_H
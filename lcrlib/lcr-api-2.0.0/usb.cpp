@@ -21,22 +21,30 @@
 #include "usb.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "hidapi-master/hidapi/hidapi.h"
 
 /***************************************************
 *                  GLOBAL VARIABLES
 ****************************************************/
 static hid_device *DeviceHandle;	//Handle to write
-//In/Out buffers equal to HID endpoint size + 1
+//Device selected by the calling thread with USB_Select(), NULL = DeviceHandle
+static USB_THREAD_LOCAL hid_device *SelectedHandle;
+//In/Out buffers equal to HID endpoint size + 1, one pair per thread
 //First byte is for Windows internal use and it is always 0
-unsigned char OutputBuffer[USB_MAX_PACKET_SIZE+1];
-unsigned char InputBuffer[USB_MAX_PACKET_SIZE+1];
+USB_THREAD_LOCAL unsigned char OutputBuffer[USB_MAX_PACKET_SIZE+1];
+USB_THREAD_LOCAL unsigned char InputBuffer[USB_MAX_PACKET_SIZE+1];
 
 static bool USBConnected = false;      //Boolean true when device is connected
 
+static hid_device *USB_Handle()
+{
+    return SelectedHandle != NULL ? SelectedHandle : DeviceHandle;
+}
+
 extern "C" bool USB_IsConnected()
 {
-    return USBConnected;
+    return SelectedHandle != NULL || USBConnected;
 }
 
 extern "C" int USB_Init(void)
@@ -66,19 +74,33 @@ extern "C" int USB_Open()
 
 extern "C" int USB_Write()
 {
-    if(DeviceHandle == NULL)
+    hid_device *handle = USB_Handle();
+
+    if(handle == NULL)
         return -1;
 
-    return hid_write(DeviceHandle, OutputBuffer, USB_MIN_PACKET_SIZE+1);
+    return hid_write(handle, OutputBuffer, USB_MIN_PACKET_SIZE+1);
+
+}
+
+extern "C" int USB_WriteReport(const unsigned char *pReport)
+{
+    hid_device *handle = USB_Handle();
+
+    if(handle == NULL)
+        return -1;
 
+    return hid_write(handle, pReport, USB_MIN_PACKET_SIZE+1);
 }
 
 extern "C" int USB_Read()
 {
-    if(DeviceHandle == NULL)
+    hid_device *handle = USB_Handle();
+
+    if(handle == NULL)
         return -1;
 
-    return hid_read_timeout(DeviceHandle, InputBuffer, USB_MIN_PACKET_SIZE+1, 2000);
+    return hid_read_timeout(handle, InputBuffer, USB_MIN_PACKET_SIZE+1, 2000);
 }
 
 extern "C" int USB_Close()
@@ -89,3 +111,78 @@ extern "C" int USB_Close()
     return 0;
 }
 
+extern "C" int USB_Enumerate(char (*pPaths)[USB_PATH_LEN], int maxDevices)
+/**
+ * Lists the paths of the controllers attached, to open them with USB_OpenPath().
+ *
+ * @param   pPaths - O - device paths
+ * @param   maxDevices - I - number of paths pPaths holds
+ *
+ * @return  number of controllers attached, can be more than maxDevices
+ *
+ */
+{
+    struct hid_device_info *pDevices, *pInfo;
+    int count = 0;
+
+    pDevices = hid_enumerate(MY_VID, MY_PID);
+    for(pInfo = pDevices; pInfo != NULL; pInfo = pInfo->next)
+    {
+        if(pInfo->path == NULL || strlen(pInfo->path) >= USB_PATH_LEN)
+            continue;
+        if(count < maxDevices)
+            strcpy(pPaths[count], pInfo->path);
+        count++;
+    }
+    hid_free_enumeration(pDevices);
+
+    return count;
+}
+
+extern "C" int USB_OpenPath(const char *path, USB_DEVICE *pDevice)
+/**
+ * Opens one of the controllers listed by USB_Enumerate(). It is used by the threads that select it
+ * with USB_Select(); the device opened with USB_Open() is not affected.
+ *
+ * @return  0 = PASS <BR>
+ *          -1 = FAIL <BR>
+ *
+ */
+{
+    memset(pDevice, 0, sizeof(USB_DEVICE));
+    if(path == NULL || strlen(path) >= USB_PATH_LEN)
+        return -1;
+
+    pDevice->Handle = hid_open_path(path);
+    if(pDevice->Handle == NULL)
+        return -1;
+
+    strcpy(pDevice->Path, path);
+    return 0;
+}
+
+extern "C" int USB_CloseDevice(USB_DEVICE *pDevice)
+{
+    if(pDevice->Handle == NULL)
+        return -1;
+
+    if(SelectedHandle == pDevice->Handle)
+        SelectedHandle = NULL;
+    hid_close((hid_device *)pDevice->Handle);
+    pDevice->Handle = NULL;
+
+    return 0;
+}
+
+extern "C" void USB_Select(USB_DEVICE *pDevice)
+/**
+ * Sends the commands of the calling thread to a device opened with USB_OpenPath(), so every
+ * LCR_ function called by the thread talks to that controller. Other threads are not affected,
+ * each one uses its own report buffers.
+ *
+ * @param   pDevice - I - device, NULL = the device opened with USB_Open()
+ *
+ */
+{
+    SelectedHandle = pDevice != NULL ? (hid_device *)pDevice->Handle : NULL;
+}
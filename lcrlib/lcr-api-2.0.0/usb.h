@@ -19,6 +19,8 @@
 #define MY_VID 0x0451
 #define MY_PID 0x6401
 
+#define USB_PATH_LEN 256    /* longest device path returned by USB_Enumerate() */
+
 #ifdef _WIN32
       #define USB_API_EXPORT __declspec(dllexport)
       #define USB_API_CALL
@@ -27,12 +29,31 @@
       #define USB_API_CALL /**< API call macro */
 #endif
 
+/* The report buffers and the device selected with USB_Select() belong to the calling thread */
+#ifdef _WIN32
+      #define USB_THREAD_LOCAL __declspec(thread)
+#else
+      #define USB_THREAD_LOCAL __thread
+#endif
+
+/* A controller opened by path, for talking to several controllers at the same time */
+typedef struct
+{
+    void *Handle;               /* hid_device */
+    char Path[USB_PATH_LEN];
+} USB_DEVICE;
+
 extern "C" int USB_API_EXPORT USB_Open(void);
 extern "C" bool USB_API_EXPORT USB_IsConnected();
 extern "C" int USB_API_EXPORT USB_Write();
+extern "C" int USB_API_EXPORT USB_WriteReport(const unsigned char *pReport);
 extern "C" int USB_API_EXPORT USB_Read();
 extern "C" int USB_API_EXPORT USB_Close();
 extern "C" int USB_API_EXPORT USB_Init();
 extern "C" int USB_API_EXPORT USB_Exit();
+extern "C" int USB_API_EXPORT USB_Enumerate(char (*pPaths)[USB_PATH_LEN], int maxDevices);
+extern "C" int USB_API_EXPORT USB_OpenPath(const char *path, USB_DEVICE *pDevice);
+extern "C" int USB_API_EXPORT USB_CloseDevice(USB_DEVICE *pDevice);
+extern "C" void USB_API_EXPORT USB_Select(USB_DEVICE *pDevice);
 
 #endif //USB_H
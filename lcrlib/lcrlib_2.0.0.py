@@ -1101,6 +1101,319 @@ def lcrReadSplashLoadTiming():
 	error_handler(flag, lcrReadSplashLoadTiming.__name__)
 	return timing_data.value
 
+def lcrSplashTimingFileChecksum(firmwarePath):
+	"""
+		RETURN:
+			CRC-32 of a firmware image file, used as the key of the splash timing database.
+	"""
+	checksum = c_uint()
+	flag = lib.LCR_SplashTimingFileChecksum(c_char_p(firmwarePath), byref(checksum))
+	error_handler(flag, lcrSplashTimingFileChecksum.__name__)
+	return checksum.value
+
+def lcrSplashTimingProfile(dbPath, firmwareChecksum, nImages=0, force=False):
+	"""
+		Measures the load time of every splash image and stores the results in the database file.
+		Nothing is measured if the database already holds the firmware, unless force is True.
+		Stop the pattern sequence first.
+
+		PARAMS:
+			dbPath 				= database file, created if missing
+			firmwareChecksum 	= checksum identifying the flash content, see lcrSplashTimingFileChecksum()
+			nImages 			= number of images in flash. 0 = measure until the controller rejects an index.
+
+		RETURN:
+			number of images in the record
+	"""
+	num_images = lib.LCR_SplashTimingProfile(c_char_p(dbPath), c_uint(firmwareChecksum), c_uint(nImages), c_bool(force))
+	error_handler(num_images, lcrSplashTimingProfile.__name__)
+	return num_images
+
+def lcrSplashTimingLoad(dbPath, firmwareChecksum):
+	"""
+		Selects the database record of the firmware for lcrGetSplashLoadTime() without measuring.
+
+		RETURN:
+			number of images in the record
+	"""
+	num_images = lib.LCR_SplashTimingLoad(c_char_p(dbPath), c_uint(firmwareChecksum))
+	error_handler(num_images, lcrSplashTimingLoad.__name__)
+	return num_images
+
+def lcrGetSplashLoadTime(index):
+	"""
+		RETURN:
+			load time of the image at index in microseconds, from the selected database record.
+	"""
+	load_time = c_uint()
+	flag = lib.LCR_GetSplashLoadTime(c_uint(index), byref(load_time))
+	error_handler(flag, lcrGetSplashLoadTime.__name__)
+	return load_time.value
+
+def lcrSeqLibOpen(path):
+	"""
+		Opens a sequence library file written by LCR_SeqLibSave(). The file is memory-mapped;
+		sequences are used in place and are valid until lcrSeqLibClose() is called.
+
+		PARAMS:
+			path 	= path of the library file.
+
+		RETURN:
+			library handle, or None on failure (missing file, bad signature/version/checksum).
+	"""
+	seq_lib_open = lib.LCR_SeqLibOpen
+	seq_lib_open.restype = c_void_p
+	return seq_lib_open(c_char_p(path))
+
+def lcrSeqLibClose(seqLib):
+	"""
+		Closes a library opened with lcrSeqLibOpen().
+	"""
+	lib.LCR_SeqLibClose(c_void_p(seqLib))
+
+def lcrSeqLibFind(seqLib, name):
+	"""
+		Looks up a sequence in an open library by name.
+
+		RETURN:
+			sequence handle to be passed to lcrSendSequence(), or None if not found.
+	"""
+	seq_lib_find = lib.LCR_SeqLibFind
+	seq_lib_find.restype = c_void_p
+	return seq_lib_find(c_void_p(seqLib), c_char_p(name))
+
+def lcrSendSequence(seq):
+	"""
+		Programs a complete pattern sequence (pattern LUT, image LUT, pattern configuration,
+		exposure, triggers and LEDs) and validates it. The sequence is left stopped.
+		Start it with lcrPatternDisplay(2).
+
+		RETURN:
+			validation status, see lcrValidatePatLutData()
+	"""
+	status = c_uint()
+	flag = lib.LCR_SendSequence(c_void_p(seq), byref(status))
+	error_handler(flag, lcrSendSequence.__name__)
+	return status.value
+
+### Scheduler actions, see lcrSchedAdd()
+SCHED_ACTION_STOP   = 0
+SCHED_ACTION_PAUSE  = 1
+SCHED_ACTION_START  = 2
+SCHED_ACTION_SPLASH = 3
+SCHED_HIST_BINS     = 32
+
+class SchedStats(Structure):
+	_fields_ = [('MinLatency', c_longlong),
+				('MaxLatency', c_longlong),
+				('MeanLatency', c_longlong),
+				('NumEvents', c_uint),
+				('NumFailed', c_uint),
+				('Histogram', c_uint * SCHED_HIST_BINS)]
+
+def lcrSchedNow():
+	"""
+		RETURN:
+			current host time in nanoseconds on the clock used for scheduler deadlines (CLOCK_MONOTONIC on Linux).
+	"""
+	sched_now = lib.LCR_SchedNow
+	sched_now.restype = c_ulonglong
+	return sched_now()
+
+def lcrSchedClear():
+	"""
+		Removes all scheduled events.
+	"""
+	lib.LCR_SchedClear()
+
+def lcrSchedAdd(deadline, action, param=0):
+	"""
+		Appends an event to the schedule. Events run in the order they are added; deadlines must not decrease.
+
+		PARAMS:
+			deadline 	= absolute time in nanoseconds, see lcrSchedNow()
+			action 		= SCHED_ACTION_STOP, SCHED_ACTION_PAUSE, SCHED_ACTION_START or SCHED_ACTION_SPLASH
+			param 		= image index for SCHED_ACTION_SPLASH
+
+		RETURN:
+			index of the event
+	"""
+	index = lib.LCR_SchedAdd(c_ulonglong(deadline), c_int(action), c_uint(param))
+	error_handler(index, lcrSchedAdd.__name__)
+	return index
+
+def lcrSchedRun(realtime=False):
+	"""
+		Blocks until all scheduled events have been sent at their deadlines.
+
+		PARAMS:
+			realtime 	= True to run with real-time priority while the schedule runs, if permitted.
+	"""
+	flag = lib.LCR_SchedRun(c_bool(realtime))
+	error_handler(flag, lcrSchedRun.__name__)
+	return flag
+
+def lcrSchedGetStats():
+	"""
+		RETURN:
+			latency statistics in nanoseconds (command written minus deadline) accumulated over all runs.
+			Histogram bin 0 counts < 1 us, bin n counts [2^(n-1), 2^n) us.
+	"""
+	stats = SchedStats()
+	flag = lib.LCR_SchedGetStats(byref(stats))
+	error_handler(flag, lcrSchedGetStats.__name__)
+
+	return {'min': stats.MinLatency,
+			'max': stats.MaxLatency,
+			'mean': stats.MeanLatency,
+			'numEvents': stats.NumEvents,
+			'numFailed': stats.NumFailed,
+			'histogram': list(stats.Histogram)}
+
+def lcrFlashFileChecksum(imagePath, address, length):
+	"""
+		Computes on the host the checksum the bootloader reports for a flash range holding the
+		firmware image file, without a device round trip.
+
+		PARAMS:
+			imagePath 	= firmware image file, starting at flash address 0
+			address 	= flash address of the range
+			length 		= size of the range in bytes
+
+		RETURN:
+			sum of the bytes of the range, modulo 2^32
+	"""
+	checksum = c_uint()
+	flag = lib.LCR_FlashFileChecksum(c_char_p(imagePath), c_uint(address), c_uint(length), byref(checksum))
+	error_handler(flag, lcrFlashFileChecksum.__name__)
+	return checksum.value
+
+FLPROG_SKIP_BOOTLOADER = 0x1
+FLPROG_ALL_SECTORS     = 0x2
+
+class FlashProgStatus(Structure):
+	_fields_ = [('BytesDone', c_uint),
+				('BytesTotal', c_uint),
+				('SectorsDone', c_uint),
+				('SectorsTotal', c_uint),
+				('BytesPerSecond', c_uint),
+				('EtaMs', c_uint)]
+
+FLPROG_PROGRESS = CFUNCTYPE(None, POINTER(FlashProgStatus), c_void_p)
+
+def lcrFlashProgram(paramsPath, newPath, oldPath=None, flags=FLPROG_SKIP_BOOTLOADER, checkpointPath=None, progress=None):
+	"""
+		Programs a firmware image file. Only the sectors that differ from the flash content are
+		reprogrammed unless flags has FLPROG_ALL_SECTORS. The controller must be in programming mode.
+
+		PARAMS:
+			paramsPath 		= flash device parameters file (Flash/FlashDeviceParameters.txt)
+			newPath 		= new firmware image file
+			oldPath 		= firmware image file currently in flash. None = compare against the
+							  checksum the controller computes for every sector.
+			flags 			= FLPROG_SKIP_BOOTLOADER, FLPROG_ALL_SECTORS
+			checkpointPath 	= file recording the verified progress. An interrupted run called again
+							  with the same image continues where it stopped. None = no checkpoint.
+			progress 		= function called with a dict of the progress, throughput and remaining time
+
+		RETURN:
+			number of sectors reprogrammed
+	"""
+	def report(pStatus, pParam):
+		status = pStatus.contents
+		progress({'bytesDone': status.BytesDone,
+				  'bytesTotal': status.BytesTotal,
+				  'sectorsDone': status.SectorsDone,
+				  'sectorsTotal': status.SectorsTotal,
+				  'bytesPerSecond': status.BytesPerSecond,
+				  'etaMs': status.EtaMs})
+
+	num_programmed = c_uint()
+	old_path = c_char_p(oldPath) if oldPath is not None else None
+	checkpoint_path = c_char_p(checkpointPath) if checkpointPath is not None else None
+	callback = FLPROG_PROGRESS(report) if progress is not None else FLPROG_PROGRESS()
+	flag = lib.LCR_FlashProgramFile(c_char_p(paramsPath), c_char_p(newPath), old_path, c_uint(flags),
+									checkpoint_path, callback, None, byref(num_programmed))
+	error_handler(flag, lcrFlashProgram.__name__)
+	return num_programmed.value
+
+def lcrFlashProgramDiff(paramsPath, newPath, oldPath=None, skipBootloader=True):
+	"""
+		Reprograms only the flash sectors that differ from the new firmware image file.
+		The controller must be in programming mode. See lcrFlashProgram().
+
+		RETURN:
+			number of sectors reprogrammed
+	"""
+	return lcrFlashProgram(paramsPath, newPath, oldPath, FLPROG_SKIP_BOOTLOADER if skipBootloader else 0)
+
+USB_PATH_LEN = 256
+
+class FlashProgUnit(Structure):
+	_fields_ = [('Path', c_char_p),
+				('pImage', c_void_p),
+				('ImageSize', c_uint),
+				('pOld', c_void_p),
+				('OldSize', c_uint),
+				('CheckpointPath', c_char_p),
+				('Result', c_int),
+				('NumProgrammed', c_uint),
+				('Status', FlashProgStatus)]
+
+FLPROG_UNIT_PROGRESS = CFUNCTYPE(None, c_uint, POINTER(FlashProgStatus), c_void_p)
+
+def lcrListDevices(maxDevices=16):
+	"""
+		Lists the device paths of the attached controllers, see lcrFlashProgramUnits().
+
+		RETURN:
+			list of device paths
+	"""
+	paths = (c_char * USB_PATH_LEN * maxDevices)()
+	count = lib.USB_Enumerate(paths, c_int(maxDevices))
+	return [paths[i].value for i in range(min(count, maxDevices))]
+
+def lcrFlashProgramUnits(paramsPath, paths, newPath, flags=FLPROG_SKIP_BOOTLOADER, checkpointDir=None, progress=None):
+	"""
+		Programs the same firmware image file to several controllers at the same time, one thread
+		per controller. Every controller must be in programming mode. A controller that fails
+		doesn't stop the others.
+
+		PARAMS:
+			paramsPath 		= flash device parameters file (Flash/FlashDeviceParameters.txt)
+			paths 			= device paths of the controllers, see lcrListDevices()
+			newPath 		= new firmware image file
+			flags 			= FLPROG_SKIP_BOOTLOADER, FLPROG_ALL_SECTORS
+			checkpointDir 	= directory of one checkpoint file per controller. None = no checkpoints.
+			progress 		= function called with the index of the controller and a dict of its progress
+
+		RETURN:
+			list of (result, number of sectors reprogrammed) per controller, result 0 = success
+	"""
+	def report(unit, pStatus, pParam):
+		status = pStatus.contents
+		progress(unit, {'bytesDone': status.BytesDone,
+						'bytesTotal': status.BytesTotal,
+						'sectorsDone': status.SectorsDone,
+						'sectorsTotal': status.SectorsTotal,
+						'bytesPerSecond': status.BytesPerSecond,
+						'etaMs': status.EtaMs})
+
+	with open(newPath, 'rb') as f:
+		image = f.read()
+
+	units = (FlashProgUnit * len(paths))()
+	for i, path in enumerate(paths):
+		units[i].Path = path
+		if checkpointDir is not None:
+			units[i].CheckpointPath = os.path.join(checkpointDir, 'unit%d.ckp' % i)
+
+	callback = FLPROG_UNIT_PROGRESS(report) if progress is not None else FLPROG_UNIT_PROGRESS()
+	flag = lib.LCR_FlashProgramUnits(c_char_p(paramsPath), units, c_uint(len(paths)), c_char_p(image),
+									 c_uint(len(image)), c_uint(flags), callback, None)
+	error_handler(flag, lcrFlashProgramUnits.__name__)
+	return [(unit.Result, unit.NumProgrammed) for unit in units]
+
 def lcrExit():
 	'''
 	'''